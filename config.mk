@@ -6,6 +6,7 @@ curl ?= 1
 debug ?= 0
 exif ?= 0
 help ?= 0
+timerfd ?= 1
 verscmp ?= 1
 xinerama ?= 1
 
@@ -63,6 +64,13 @@ ifeq (${stat64},1)
 	CFLAGS += -D_FILE_OFFSET_BITS=64
 endif
 
+ifeq (${timerfd},1)
+	CFLAGS += -DHAVE_TIMERFD
+	MAN_TIMERFD = enabled
+else
+	MAN_TIMERFD = disabled
+endif
+
 ifeq (${verscmp},1)
 	CFLAGS += -DHAVE_VERSCMP
 	MAN_VERSCMP = enabled
@@ -94,4 +102,4 @@ MAN_DATE ?= ${shell date '+%B %d, %Y'}
 CFLAGS += -DPREFIX=\"${PREFIX}\" \
 	-DPACKAGE=\"${PACKAGE}\" -DVERSION=\"${VERSION}\"
 
-LDLIBS += -lm -lpng -lX11 -lImlib2
+LDLIBS += -lm -lpng -lpthread -lX11 -lImlib2
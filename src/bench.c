@@ -0,0 +1,339 @@
+/* bench.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/*
+ * feh-bench: a headless benchmark of the image pipeline.
+ *
+ * For every input image, this times the steps feh takes to get it on
+ * screen and into a thumbnail, using the same functions as feh itself:
+ *
+ *   load       feh_load_image and forcing Imlib2 to decode the pixels
+ *   orient     the rotation applied for Exif orientation
+ *   render     anti-aliased scaling to fit the screen, as in
+ *              winwidget_render_image, but onto an image instead of a
+ *              pixmap so no X server is needed
+ *   thumbnail  scaling to a 128x128 box, as in feh_thumbnail_generate
+ *
+ * and prints throughput and latency percentiles for each step as JSON.
+ */
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "metrics.h"
+
+#define BENCH_THUMB_DIM 128
+
+enum bench_stage {
+	STAGE_LOAD,
+	STAGE_ORIENT,
+	STAGE_RENDER,
+	STAGE_THUMBNAIL,
+	STAGE_TOTAL,
+	STAGE_COUNT
+};
+
+static const char *stage_names[STAGE_COUNT] = {
+	"load", "orient", "render", "thumbnail", "total"
+};
+
+typedef struct {
+	long long *samples;
+	int count;
+	long long total_ns;
+	double bytes;
+} bench_stage_stats;
+
+static bench_stage_stats stats[STAGE_COUNT];
+
+/* These are defined in main.c, which feh-bench is not linked with */
+char **cmdargv = NULL;
+int cmdargc = 0;
+char *mode = NULL;
+
+int feh_main_iteration(void)
+{
+	return(0);
+}
+
+void feh_clean_exit(void)
+{
+	return;
+}
+
+static void bench_usage(void)
+{
+	fputs("Usage: feh-bench [-i ITERATIONS] [-g WIDTHxHEIGHT] "
+			"[-s WIDTHxHEIGHT]... [FILE]...\n"
+			"  -i  Process every image ITERATIONS times (default 5)\n"
+			"  -g  Screen size to render to (default 1920x1080)\n"
+			"  -s  Add a synthetic image of the given size\n", stderr);
+	exit(1);
+}
+
+static void bench_parse_size(char *arg, int *w, int *h)
+{
+	if ((sscanf(arg, "%dx%d", w, h) != 2) || (*w <= 0) || (*h <= 0))
+		eprintf("Invalid size \"%s\"", arg);
+	return;
+}
+
+/*
+ * Write a noisy gradient to a PNG, so that decoding it costs about as much
+ * as decoding a photo of the same size would.
+ */
+static char *bench_create_synthetic(char *dir, int w, int h)
+{
+	Imlib_Image im;
+	DATA32 *data;
+	unsigned int seed = 1;
+	char name[64];
+	char *path;
+	int x, y;
+
+	im = imlib_create_image(w, h);
+	if (!im)
+		eprintf("Cannot create a %dx%d image", w, h);
+	imlib_context_set_image(im);
+	data = imlib_image_get_data();
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			seed = seed * 1103515245 + 12345;
+			data[y * w + x] = 0xff000000
+				| (((x * 255 / w) ^ (seed >> 28)) << 16)
+				| (((y * 255 / h) ^ (seed >> 24 & 0xf)) << 8)
+				| (seed >> 16 & 0xff);
+		}
+	}
+	imlib_image_put_back_data(data);
+	imlib_image_set_has_alpha(0);
+
+	snprintf(name, sizeof(name), "%dx%d.png", w, h);
+	path = estrjoin("/", dir, name, NULL);
+	gib_imlib_save_image(im, path);
+	gib_imlib_free_image_and_decache(im);
+
+	return(path);
+}
+
+static void bench_record(enum bench_stage stage, long long start, double bytes)
+{
+	bench_stage_stats *s = &stats[stage];
+	long long dur = feh_metric_now() - start;
+
+	s->samples[s->count++] = dur;
+	s->total_ns += dur;
+	s->bytes += bytes;
+	return;
+}
+
+/* Run one image through the pipeline. Returns 0 if it cannot be loaded. */
+static int bench_image(feh_file *file, int screen_w, int screen_h, int timed)
+{
+	Imlib_Image im, clone, canvas, thumb;
+	struct stat st;
+	long long start, pipeline_start;
+	double pixel_bytes;
+	double zoom;
+	int w, h;
+
+	if (stat(file->filename, &st))
+		return(0);
+
+	pipeline_start = start = feh_metric_now();
+	if (!feh_load_image(&im, file))
+		return(0);
+	gib_imlib_image_decode(im);
+	w = gib_imlib_image_get_width(im);
+	h = gib_imlib_image_get_height(im);
+	pixel_bytes = (double) w * h * 4;
+	if (timed)
+		bench_record(STAGE_LOAD, start, st.st_size);
+
+	clone = gib_imlib_clone_image(im);
+	start = feh_metric_now();
+	gib_imlib_image_orientate(clone, 1);
+	if (timed)
+		bench_record(STAGE_ORIENT, start, pixel_bytes);
+	gib_imlib_free_image_and_decache(clone);
+
+	zoom = (double) screen_w / w;
+	if ((double) screen_h / h < zoom)
+		zoom = (double) screen_h / h;
+	canvas = imlib_create_image(screen_w, screen_h);
+	start = feh_metric_now();
+	gib_imlib_blend_image_onto_image(canvas, im, 0, 0, 0, w, h,
+			(screen_w - w * zoom) / 2, (screen_h - h * zoom) / 2,
+			w * zoom, h * zoom, 1, 0, 1);
+	if (timed)
+		bench_record(STAGE_RENDER, start, pixel_bytes);
+	gib_imlib_free_image_and_decache(canvas);
+
+	zoom = (double) BENCH_THUMB_DIM / ((w > h) ? w : h);
+	if (zoom > 1.0)
+		zoom = 1.0;
+	start = feh_metric_now();
+	thumb = gib_imlib_create_cropped_scaled_image(im, 0, 0, w, h,
+			w * zoom, h * zoom, 1);
+	if (timed)
+		bench_record(STAGE_THUMBNAIL, start, pixel_bytes);
+	gib_imlib_free_image_and_decache(thumb);
+
+	gib_imlib_free_image_and_decache(im);
+	if (timed)
+		bench_record(STAGE_TOTAL, pipeline_start, st.st_size);
+	return(1);
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+	long long x = *(const long long *) a, y = *(const long long *) b;
+
+	return((x > y) - (x < y));
+}
+
+/* Nearest-rank percentile of the sorted samples, in milliseconds */
+static double bench_percentile(bench_stage_stats *s, int percent)
+{
+	int rank = (s->count * percent + 99) / 100;
+
+	if (!s->count)
+		return(0.0);
+	if (rank < 1)
+		rank = 1;
+	return(s->samples[rank - 1] / 1e6);
+}
+
+static void bench_print(int images, int iterations, int screen_w, int screen_h)
+{
+	bench_stage_stats *s;
+	double secs;
+	int i;
+
+	printf("{\n\t\"version\": \"%s\",\n\t\"images\": %d,\n"
+			"\t\"iterations\": %d,\n\t\"screen\": \"%dx%d\",\n"
+			"\t\"stages\": {\n", VERSION, images, iterations,
+			screen_w, screen_h);
+
+	for (i = 0; i < STAGE_COUNT; i++) {
+		s = &stats[i];
+		qsort(s->samples, s->count, sizeof(long long), bench_compare);
+		secs = s->total_ns / 1e9;
+		printf("\t\t\"%s\": {\"count\": %d, \"images_per_s\": %.2f, "
+				"\"mb_per_s\": %.2f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+				"\"p99_ms\": %.3f, \"max_ms\": %.3f}%s\n",
+				stage_names[i], s->count,
+				secs > 0 ? s->count / secs : 0.0,
+				secs > 0 ? s->bytes / secs / (1024 * 1024) : 0.0,
+				bench_percentile(s, 50), bench_percentile(s, 90),
+				bench_percentile(s, 99), bench_percentile(s, 100),
+				(i < STAGE_COUNT - 1) ? "," : "");
+	}
+	puts("\t}\n}");
+	return;
+}
+
+int main(int argc, char **argv)
+{
+	gib_list *l, *synthetic = NULL;
+	feh_file **files;
+	char tmpdir[PATH_MAX];
+	char *dir = NULL;
+	int iterations = 5;
+	int screen_w = 1920, screen_h = 1080;
+	int file_count = 0, loaded = 0;
+	int optch, w, h, i, j;
+
+	memset(&opt, 0, sizeof(fehoptions));
+	opt.conversion_timeout = -1;
+#ifdef HAVE_LIBEXIF
+	opt.auto_rotate = 1;
+#endif
+	opt.quiet = 1;
+
+	while ((optch = getopt(argc, argv, "g:i:s:")) != -1) {
+		switch (optch) {
+		case 'g':
+			bench_parse_size(optarg, &screen_w, &screen_h);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			if (iterations < 1)
+				eprintf("Invalid iteration count \"%s\"", optarg);
+			break;
+		case 's':
+			bench_parse_size(optarg, &w, &h);
+			if (!dir) {
+				snprintf(tmpdir, sizeof(tmpdir), "%s/feh-bench.XXXXXX",
+						getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+				if (!(dir = mkdtemp(tmpdir)))
+					eprintf("Cannot create a temporary directory:");
+			}
+			synthetic = gib_list_add_end(synthetic,
+					bench_create_synthetic(dir, w, h));
+			break;
+		default:
+			bench_usage();
+		}
+	}
+
+	files = emalloc((argc - optind + gib_list_length(synthetic) + 1)
+			* sizeof(feh_file *));
+	for (i = optind; i < argc; i++)
+		files[file_count++] = feh_file_new(argv[i]);
+	for (l = synthetic; l; l = l->next)
+		files[file_count++] = feh_file_new(l->data);
+	if (!file_count)
+		bench_usage();
+
+	/* time decoding, not Imlib2's cache */
+	imlib_set_cache_size(0);
+
+	for (i = 0; i < STAGE_COUNT; i++)
+		stats[i].samples = emalloc(file_count * iterations * sizeof(long long));
+
+	/* untimed pass to fill the page cache and weed out broken files */
+	for (i = 0; i < file_count; i++) {
+		if (bench_image(files[i], screen_w, screen_h, 0))
+			files[loaded++] = files[i];
+		else
+			weprintf("%s: cannot load, skipping", files[i]->filename);
+	}
+	if (!loaded)
+		eprintf("No loadable images");
+
+	for (j = 0; j < iterations; j++)
+		for (i = 0; i < loaded; i++)
+			bench_image(files[i], screen_w, screen_h, 1);
+
+	bench_print(loaded, iterations, screen_w, screen_h);
+
+	for (l = synthetic; l; l = l->next)
+		unlink(l->data);
+	if (dir)
+		rmdir(dir);
+
+	return(0);
+}
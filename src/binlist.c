@@ -0,0 +1,304 @@
+/* binlist.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "binlist.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <stdint.h>
+
+/*
+ * Binary filelists.
+ *
+ * A text filelist has to be parsed line by line, which gets slow for very
+ * large lists. The binary format is meant to be mapped and walked instead:
+ *
+ *   header
+ *   uint64_t offsets[count]        start of each file name in the strings
+ *   char strings[strings_size]     NUL-terminated file names and formats
+ *   binlist_info infos[count]      optional, see header.info_offset
+ *
+ * The info records hold the file infos known when the list was written,
+ * along with the size and mtime of the file they describe, so that
+ * feh_file_info_preload can tell whether they are still valid. Until it has
+ * checked them they are kept in listed_info rather than info, so a file
+ * which changed since does not show stale dimensions. They also note whether
+ * --auto-rotate was in effect, since it swaps the dimensions of rotated
+ * JPEGs. All fields are in native byte order.
+ */
+
+#define BINLIST_MAGIC 0x4c484546	/* "FEHL" in little endian */
+#define BINLIST_VERSION 1
+#define BINLIST_NO_FORMAT UINT32_MAX
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t count;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t info_offset;	/* 0 if there are no infos */
+} binlist_header;
+
+typedef struct {
+	int64_t mtime_ns;	/* 0 if this file has no info */
+	int64_t size;
+	int32_t width;
+	int32_t height;
+	uint32_t format;	/* offset into strings, or BINLIST_NO_FORMAT */
+	uint8_t has_alpha;
+	uint8_t auto_rotate;
+	uint8_t probed;		/* read from the image header only */
+	uint8_t reserved[1];
+} binlist_info;
+
+/* The auto_rotate flag for infos loaded with the current options */
+static uint8_t feh_binlist_auto_rotate(void)
+{
+#ifdef HAVE_LIBEXIF
+	return(opt.auto_rotate ? 1 : 0);
+#else
+	return(0);
+#endif
+}
+
+/* Whether filename is a binary filelist */
+int feh_binlist_detect(char *filename)
+{
+	uint32_t magic = 0;
+	FILE *fp;
+	int ret;
+
+	if (!(fp = fopen(filename, "r")))
+		return(0);
+	ret = (fread(&magic, sizeof(magic), 1, fp) == 1) && (magic == BINLIST_MAGIC);
+	fclose(fp);
+	return(ret);
+}
+
+gib_list *feh_binlist_read(char *filename)
+{
+	binlist_header *header;
+	binlist_info *infos = NULL, *bi;
+	gib_list *list = NULL;
+	uint64_t *offsets, i;
+	struct stat st;
+	feh_file *file;
+	feh_file_info *info;
+	char *strings;
+	void *map;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0)
+		return(NULL);
+	if (fstat(fd, &st) || (st.st_size < (off_t) sizeof(binlist_header))) {
+		close(fd);
+		weprintf("%s is not a valid binary filelist", filename);
+		return(NULL);
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		weprintf("cannot map filelist %s:", filename);
+		return(NULL);
+	}
+
+	header = map;
+	if ((header->magic != BINLIST_MAGIC) || (header->version != BINLIST_VERSION)
+			|| (header->count > (uint64_t) st.st_size / sizeof(uint64_t))
+			|| (sizeof(binlist_header) + header->count * sizeof(uint64_t)
+				> header->strings_offset)
+			|| (header->strings_offset > (uint64_t) st.st_size)
+			|| (header->strings_size > (uint64_t) st.st_size - header->strings_offset)
+			|| (header->strings_size == 0)
+			|| (header->info_offset && ((header->info_offset > (uint64_t) st.st_size)
+				|| (header->count > ((uint64_t) st.st_size - header->info_offset)
+					/ sizeof(binlist_info))))) {
+		weprintf("%s is not a valid binary filelist (or was written by a "
+				"different version of feh)", filename);
+		munmap(map, st.st_size);
+		return(NULL);
+	}
+
+	offsets = (uint64_t *) ((char *) map + sizeof(binlist_header));
+	strings = (char *) map + header->strings_offset;
+	if (header->info_offset)
+		infos = (binlist_info *) ((char *) map + header->info_offset);
+
+	/* every string must be terminated within the table */
+	if (strings[header->strings_size - 1] != '\0') {
+		weprintf("%s is not a valid binary filelist", filename);
+		munmap(map, st.st_size);
+		return(NULL);
+	}
+
+	for (i = 0; i < header->count; i++) {
+		if (offsets[i] >= header->strings_size)
+			continue;
+		file = feh_file_new(strings + offsets[i]);
+
+		bi = infos ? &infos[i] : NULL;
+		if (bi && bi->mtime_ns && (bi->auto_rotate == feh_binlist_auto_rotate())) {
+			info = feh_file_info_new();
+			info->width = bi->width;
+			info->height = bi->height;
+			info->pixels = bi->width * bi->height;
+			info->size = bi->size;
+			info->has_alpha = bi->has_alpha;
+			info->probed = bi->probed;
+			info->mtime_ns = bi->mtime_ns;
+			if (bi->format < header->strings_size)
+				info->format = estrdup(strings + bi->format);
+			file->listed_info = info;
+		}
+
+		/* like the text format, the list is built back to front */
+		list = gib_list_add_front(list, file);
+	}
+
+	munmap(map, st.st_size);
+	return(list);
+}
+
+/* The info to store for file, if any: the checked one, else the one read from a list */
+static feh_file_info *feh_binlist_file_info(feh_file * file)
+{
+	if (file->info && file->info->mtime_ns)
+		return(file->info);
+	if (file->listed_info && file->listed_info->mtime_ns)
+		return(file->listed_info);
+	return(NULL);
+}
+
+int feh_binlist_write(gib_list * list, char *filename)
+{
+	binlist_header header;
+	binlist_info bi;
+	gib_list *l;
+	feh_file *file;
+	feh_file_info *info;
+	char **formats = NULL;
+	uint64_t *format_offsets = NULL;
+	uint64_t offset = 0, formats_size = 0;
+	int format_count = 0, has_info = 0, i, ok;
+	FILE *fp;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = BINLIST_MAGIC;
+	header.version = BINLIST_VERSION;
+
+	for (l = list; l; l = l->next) {
+		file = FEH_FILE(l->data);
+		header.count++;
+		header.strings_size += strlen(file->filename) + 1;
+		if (!(info = feh_binlist_file_info(file)))
+			continue;
+		has_info = 1;
+
+		/* there are only a handful of formats, so store each one once */
+		if (!info->format)
+			continue;
+		for (i = 0; i < format_count; i++)
+			if (!strcmp(formats[i], info->format))
+				break;
+		if (i == format_count) {
+			formats = erealloc(formats, (format_count + 1) * sizeof(char *));
+			format_offsets = erealloc(format_offsets,
+					(format_count + 1) * sizeof(uint64_t));
+			formats[format_count] = info->format;
+			format_offsets[format_count] = formats_size;
+			formats_size += strlen(info->format) + 1;
+			format_count++;
+		}
+	}
+
+	/* formats go after the file names */
+	for (i = 0; i < format_count; i++)
+		format_offsets[i] += header.strings_size;
+	header.strings_size += formats_size;
+
+	header.strings_offset = sizeof(header) + header.count * sizeof(uint64_t);
+	if (has_info) {
+		/* align the info records */
+		header.info_offset = header.strings_offset + header.strings_size;
+		header.info_offset = (header.info_offset + 7) & ~(uint64_t) 7;
+	}
+
+	errno = 0;
+	if ((fp = fopen(filename, "w")) == NULL) {
+		weprintf("can't write filelist %s:", filename);
+		free(formats);
+		free(format_offsets);
+		return(0);
+	}
+
+	ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+	for (l = list; ok && l; l = l->next) {
+		ok = (fwrite(&offset, sizeof(offset), 1, fp) == 1);
+		offset += strlen(FEH_FILE(l->data)->filename) + 1;
+	}
+	for (l = list; ok && l; l = l->next) {
+		file = FEH_FILE(l->data);
+		ok = (fwrite(file->filename, strlen(file->filename) + 1, 1, fp) == 1);
+	}
+	for (i = 0; ok && (i < format_count); i++)
+		ok = (fwrite(formats[i], strlen(formats[i]) + 1, 1, fp) == 1);
+
+	if (ok && has_info) {
+		for (offset = header.strings_offset + header.strings_size;
+				ok && (offset < header.info_offset); offset++)
+			ok = (fputc('\0', fp) != EOF);
+
+		for (l = list; ok && l; l = l->next) {
+			file = FEH_FILE(l->data);
+			memset(&bi, 0, sizeof(bi));
+			bi.format = BINLIST_NO_FORMAT;
+			if ((info = feh_binlist_file_info(file))) {
+				bi.mtime_ns = info->mtime_ns;
+				bi.size = info->size;
+				bi.width = info->width;
+				bi.height = info->height;
+				bi.has_alpha = info->has_alpha;
+				bi.probed = info->probed;
+				bi.auto_rotate = feh_binlist_auto_rotate();
+				for (i = 0; info->format && (i < format_count); i++)
+					if (!strcmp(formats[i], info->format))
+						bi.format = format_offsets[i];
+			}
+			ok = (fwrite(&bi, sizeof(bi), 1, fp) == 1);
+		}
+	}
+
+	free(formats);
+	free(format_offsets);
+
+	if ((fclose(fp) != 0) || !ok) {
+		weprintf("can't write filelist %s:", filename);
+		return(0);
+	}
+	return(1);
+}
@@ -0,0 +1,295 @@
+/* dirscan.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/* d_type and the DT_* constants are not part of POSIX */
+#define _DEFAULT_SOURCE
+
+#include "feh.h"
+#include "options.h"
+#include "dirscan.h"
+#include <fcntl.h>
+#include <pthread.h>
+
+/*
+ * Directory scanning for the filelist.
+ *
+ * Directories are read by a pool of threads, so that on network
+ * filesystems many of them are in flight at once. The entry type reported
+ * by readdir is trusted where available; only symlinks and file systems
+ * which do not report types cost an extra stat, which is done relative to
+ * the open directory.
+ *
+ * The main thread walks the resulting tree in the same order as the
+ * previous recursive scandir/alphasort implementation did, and passes each
+ * file on as soon as every directory before it has been read.
+ */
+
+#define SCAN_THREADS 8
+
+enum scan_type { SCAN_FILE, SCAN_DIR, SCAN_ERROR };
+
+typedef struct __scan_dir scan_dir;
+
+typedef struct {
+	char *name;
+	enum scan_type type;
+	/* errno of the failed stat for SCAN_ERROR */
+	int error;
+	/* the subdirectory for SCAN_DIR */
+	scan_dir *dir;
+} scan_entry;
+
+struct __scan_dir {
+	char *path;
+	int done;
+	/* errno if the directory could not be opened */
+	int error;
+	scan_entry *entries;
+	int count;
+	/* next directory in the job stack */
+	scan_dir *next;
+};
+
+/* job stack and done flags, guarded by scan_lock */
+static pthread_mutex_t scan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scan_job_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t scan_done_cond = PTHREAD_COND_INITIALIZER;
+static scan_dir *scan_jobs = NULL;
+static int scan_finished = 0;
+
+static scan_dir *feh_scan_dir_new(char *path)
+{
+	scan_dir *d = emalloc(sizeof(scan_dir));
+
+	d->path = path;
+	d->done = 0;
+	d->error = 0;
+	d->entries = NULL;
+	d->count = 0;
+	d->next = NULL;
+	return(d);
+}
+
+static int feh_scan_cmp(const void *a, const void *b)
+{
+	return(strcoll(((const scan_entry *) a)->name, ((const scan_entry *) b)->name));
+}
+
+/*
+ * Read and sort the entries of d. With recursive set, subdirectories
+ * become scan_dirs of their own, otherwise they are left out.
+ */
+static void feh_scan_read(scan_dir *d, int recursive)
+{
+	struct dirent *de;
+	struct stat st;
+	DIR *dir;
+	scan_entry *e;
+	int size = 0;
+	int fd;
+
+	if ((fd = open(d->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+		d->error = errno;
+		return;
+	}
+	if (!(dir = fdopendir(fd))) {
+		d->error = errno;
+		close(fd);
+		return;
+	}
+
+	while ((de = readdir(dir))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+
+		if (d->count == size) {
+			size = size ? size * 2 : 64;
+			d->entries = erealloc(d->entries, size * sizeof(scan_entry));
+		}
+		e = &d->entries[d->count];
+		e->error = 0;
+		e->dir = NULL;
+		e->type = SCAN_ERROR;
+
+#ifdef DT_UNKNOWN
+		if (de->d_type == DT_REG)
+			e->type = SCAN_FILE;
+		else if (de->d_type == DT_DIR)
+			e->type = SCAN_DIR;
+		else if ((de->d_type != DT_LNK) && (de->d_type != DT_UNKNOWN))
+			continue;
+#endif
+		if (e->type == SCAN_ERROR) {
+			if (fstatat(fd, de->d_name, &st, 0))
+				e->error = errno;
+			else if (S_ISREG(st.st_mode))
+				e->type = SCAN_FILE;
+			else if (S_ISDIR(st.st_mode))
+				e->type = SCAN_DIR;
+			else
+				continue;
+		}
+
+		if ((e->type == SCAN_DIR) && !recursive)
+			continue;
+
+		e->name = estrdup(de->d_name);
+		d->count++;
+	}
+	closedir(dir);
+
+	qsort(d->entries, d->count, sizeof(scan_entry), feh_scan_cmp);
+	return;
+}
+
+static void *feh_scan_worker(void *unused __attribute__((unused)))
+{
+	scan_dir *d;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&scan_lock);
+		while (!scan_jobs && !scan_finished)
+			pthread_cond_wait(&scan_job_cond, &scan_lock);
+		if (!scan_jobs) {
+			pthread_mutex_unlock(&scan_lock);
+			return(NULL);
+		}
+		d = scan_jobs;
+		scan_jobs = d->next;
+		pthread_mutex_unlock(&scan_lock);
+
+		feh_scan_read(d, 1);
+
+		for (i = 0; i < d->count; i++)
+			if (d->entries[i].type == SCAN_DIR)
+				d->entries[i].dir = feh_scan_dir_new(
+						estrjoin("/", d->path, d->entries[i].name, NULL));
+
+		/*
+		 * Push the subdirectories so that the first one is read next.
+		 * It is also the first one the main thread will wait for.
+		 */
+		pthread_mutex_lock(&scan_lock);
+		for (i = d->count - 1; i >= 0; i--) {
+			if (d->entries[i].dir) {
+				d->entries[i].dir->next = scan_jobs;
+				scan_jobs = d->entries[i].dir;
+			}
+		}
+		d->done = 1;
+		pthread_cond_broadcast(&scan_job_cond);
+		pthread_cond_broadcast(&scan_done_cond);
+		pthread_mutex_unlock(&scan_lock);
+	}
+	return(NULL);
+}
+
+/* Wait for d to be read, pass on its contents in order and free it */
+static void feh_scan_emit(scan_dir *d, void (*add_file)(char *path),
+		void (*add_dir)(char *path), void (*stat_error)(char *path))
+{
+	char *path;
+	int i;
+
+	pthread_mutex_lock(&scan_lock);
+	while (!d->done)
+		pthread_cond_wait(&scan_done_cond, &scan_lock);
+	pthread_mutex_unlock(&scan_lock);
+
+	if (d->error) {
+		if (!opt.quiet) {
+			errno = d->error;
+			weprintf("couldn't open directory %s:", d->path);
+		}
+	} else if (add_dir)
+		add_dir(d->path);
+
+	for (i = 0; i < d->count; i++) {
+		if (d->entries[i].dir)
+			feh_scan_emit(d->entries[i].dir, add_file, add_dir, stat_error);
+		else {
+			path = estrjoin("/", d->path, d->entries[i].name, NULL);
+			if (d->entries[i].type == SCAN_ERROR) {
+				errno = d->entries[i].error;
+				stat_error(path);
+			} else {
+				D(("Adding regular file %s to filelist\n", path));
+				add_file(path);
+			}
+			free(path);
+		}
+		free(d->entries[i].name);
+	}
+	free(d->entries);
+	free(d->path);
+	free(d);
+	return;
+}
+
+/*
+ * Pass every file in the directory path to add_file, in alphabetical
+ * order, descending into subdirectories if recursive is set. Every
+ * directory which was read is passed to add_dir, unless it is NULL.
+ * Entries which cannot be stat'ed are passed to stat_error with errno set.
+ */
+void feh_scan_directory(char *path, int recursive, void (*add_file)(char *path),
+		void (*add_dir)(char *path), void (*stat_error)(char *path))
+{
+	pthread_t threads[SCAN_THREADS];
+	scan_dir *top = feh_scan_dir_new(estrdup(path));
+	int thread_count = 0;
+	int i;
+
+	if (!recursive) {
+		feh_scan_read(top, 0);
+		top->done = 1;
+		feh_scan_emit(top, add_file, add_dir, stat_error);
+		return;
+	}
+
+	scan_jobs = top;
+	scan_finished = 0;
+	for (i = 0; i < SCAN_THREADS; i++)
+		if (pthread_create(&threads[thread_count], NULL, feh_scan_worker, NULL) == 0)
+			thread_count++;
+
+	if (thread_count == 0) {
+		/* no threads to be had: read everything up front */
+		scan_finished = 1;
+		feh_scan_worker(NULL);
+	}
+
+	feh_scan_emit(top, add_file, add_dir, stat_error);
+
+	pthread_mutex_lock(&scan_lock);
+	scan_finished = 1;
+	pthread_cond_broadcast(&scan_job_cond);
+	pthread_mutex_unlock(&scan_lock);
+
+	for (i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+	return;
+}
@@ -31,6 +31,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "options.h"
 #include "events.h"
 #include "thumbnail.h"
+#include "imagecache.h"
 
 #define FEH_JITTER_OFFSET 2
 #define FEH_JITTER_TIME 1
@@ -423,6 +424,7 @@ void feh_event_handle_ConfigureNotify(XEvent * ev)
 				w->w = ev->xconfigure.width;
 				w->h = ev->xconfigure.height;
 				w->had_resize = 1;
+				feh_frame_cache_flush();
 				if (opt.geom_flags & WidthValue || opt.geom_flags & HeightValue) {
 					opt.geom_w = w->w;
 					opt.geom_h = w->h;
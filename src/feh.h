@@ -152,7 +152,7 @@ void feh_event_handle_stdin();
 void feh_event_handle_generic(winwidget winwid, unsigned int state, KeySym keysym, unsigned int button);
 fehkey *feh_str_to_kb(char * action);
 void feh_action_run(feh_file * file, char *action, winwidget winwid);
-char *format_size(int size);
+char *format_size(long long size);
 char *feh_printf(char *str, feh_file * file, winwidget winwid);
 void im_weprintf(winwidget w, char *fmt, ...);
 void feh_draw_zoom(winwidget w);
@@ -160,6 +160,7 @@ void feh_draw_checks(winwidget win);
 void cb_slide_timer(void *data);
 void cb_reload_timer(void *data);
 int feh_load_image_char(Imlib_Image * im, char *filename);
+int feh_load_image_quiet(Imlib_Image * im, feh_file * file);
 void feh_draw_filename(winwidget w);
 #ifdef HAVE_LIBEXIF
 void feh_draw_exif(winwidget w);
@@ -181,6 +182,7 @@ char *build_caption_filename(feh_file * file, short create_dir);
 gib_list *feh_list_jump(gib_list * root, gib_list * l, int direction, int num);
 gib_list *feh_list_jump_to_pic(gib_list * root, gib_list * l, int index);
 void slideshow_change_image_by_index(winwidget winwid, int index);
+void slideshow_preroll_index(winwidget winwid, int index);
 
 /* Imlib stuff */
 extern Display *disp;
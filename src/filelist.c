@@ -31,7 +31,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "feh.h"
 #include "filelist.h"
 #include "signals.h"
+#include "winwidget.h"
+#include "prefetch.h"
+#include "dirscan.h"
+#include "timers.h"
+#include "watch.h"
+#include "infocache.h"
+#include "probe.h"
+#include "binlist.h"
+#include "stream.h"
 #include "options.h"
+#include <pthread.h>
+#include <stdint.h>
 
 gib_list *filelist = NULL;
 gib_list *original_file_items = NULL; /* original file items from argv */
@@ -41,21 +52,136 @@ extern int errno;
 
 static gib_list *rm_filelist = NULL;
 
+/* the last filelist read by feh_read_filelist, if it was a binary one */
+static char *binary_filelist = NULL;
+
+/* upper bound for the number of feh_file_info_preload threads */
+#define PRELOAD_THREADS_MAX 64
+
+/*
+ * A file for feh_file_info_preload. Worker threads stat it and look up its
+ * info in --info-cache or its header; anything needing Imlib2 is left to
+ * the main thread.
+ */
+typedef struct {
+	feh_file *file;
+	struct stat st;
+	int stat_errno;
+	int cached;
+	feh_file_info *probed;
+	int done;
+} preload_job;
+
+static preload_job *preload_jobs = NULL;
+static int preload_job_count = 0;
+static int preload_next_job = 0;
+static pthread_mutex_t preload_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t preload_done_cond = PTHREAD_COND_INITIALIZER;
+
+static void feh_file_info_set_probed(feh_file * file, struct stat *st, feh_file_info * info);
+static void feh_filelist_index_remove(gib_list * l);
+
+/*
+ * Array of the nodes of filelist, so that the n-th file and the position of
+ * a file can be found without walking the list. Anything which adds or
+ * reorders filelist entries must call feh_filelist_changed; the index is
+ * then rebuilt on its next use.
+ *
+ * Files removed through feh_file_remove_from_list only leave a hole in the
+ * array, so removing one slide at a time does not mean rebuilding the
+ * index for each. While there are holes, a Fenwick tree counting the files
+ * left in each slot range maps positions to slots and back in O(log n).
+ * The index is compacted once a quarter of its slots are holes.
+ */
+static gib_list **filelist_index = NULL;
+static int filelist_index_len = 0;	/* slots in use, including holes */
+static int filelist_index_size = 0;
+static int filelist_index_valid = 0;
+static int filelist_index_holes = 0;
+static int *filelist_index_tree = NULL;	/* 1-based, valid while there are holes */
+
+
+/*
+ * feh_file structures are carved out of FILE_BLOCK_SIZE blocks together with
+ * their filename, and name points into filename. This saves two mallocs per
+ * file and keeps large filelists compact. Blocks are aligned to their size,
+ * so the block of a file is found by masking its address. A block is freed
+ * as soon as none of its files are in use anymore, so e.g. a --reload which
+ * rebuilds the filelist returns the memory of the old one.
+ *
+ * Releasing a filelist is still O(n), not a single arena reset: the list
+ * nodes come from gib_list, which is shared with menus, text layout and
+ * every other list in feh and free()s nodes itself, and the info, caption
+ * and EXIF data a file may carry are allocated separately. Each file has to
+ * be visited to free those anyway.
+ */
+#define FILE_BLOCK_SIZE (256 * 1024)
+#define FILE_ALIGN 16
+#define FILE_ALIGN_UP(n) (((n) + FILE_ALIGN - 1) & ~((size_t) FILE_ALIGN - 1))
+
+typedef struct {
+	size_t used;
+	int live;
+} feh_file_block;
+
+#define FILE_BLOCK_HEADER FILE_ALIGN_UP(sizeof(feh_file_block))
+#define FILE_BLOCK(file) \
+	((feh_file_block *) ((uintptr_t) (file) & ~((uintptr_t) FILE_BLOCK_SIZE - 1)))
+
+/* the block new files are allocated from */
+static feh_file_block *file_block = NULL;
+
+static feh_file *feh_file_alloc(size_t size)
+{
+	feh_file_block *block = file_block;
+	feh_file *file;
+	size_t bytes;
+	void *mem;
+
+	size = FILE_ALIGN_UP(size);
+
+	if (!block || (block->used + size > FILE_BLOCK_SIZE)) {
+		/* absurdly long URLs get a block of their own */
+		bytes = FILE_BLOCK_HEADER + size;
+		if (bytes < FILE_BLOCK_SIZE)
+			bytes = FILE_BLOCK_SIZE;
+		if (posix_memalign(&mem, FILE_BLOCK_SIZE, bytes))
+			eprintf("malloc of %u bytes failed:", (unsigned int) bytes);
+		block = mem;
+		block->used = FILE_BLOCK_HEADER;
+		block->live = 0;
+
+		if (FILE_BLOCK_HEADER + size <= FILE_BLOCK_SIZE) {
+			/* the old block is freed by its last feh_file_free */
+			if (file_block && !file_block->live)
+				free(file_block);
+			file_block = block;
+		}
+	}
+
+	file = (feh_file *) ((char *) block + block->used);
+	block->used += size;
+	block->live++;
+	return(file);
+}
 
 feh_file *feh_file_new(char *filename)
 {
 	feh_file *newfile;
+	size_t len = strlen(filename) + 1;
 	char *s;
 
-	newfile = (feh_file *) emalloc(sizeof(feh_file));
+	newfile = feh_file_alloc(sizeof(feh_file) + len);
 	newfile->caption = NULL;
-	newfile->filename = estrdup(filename);
-	s = strrchr(filename, '/');
+	newfile->filename = memcpy((char *) (newfile + 1), filename, len);
+	s = strrchr(newfile->filename, '/');
 	if (s)
-		newfile->name = estrdup(s + 1);
+		newfile->name = s + 1;
 	else
-		newfile->name = estrdup(filename);
+		newfile->name = newfile->filename;
 	newfile->info = NULL;
+	newfile->listed_info = NULL;
+	newfile->list_pos = -1;
 #ifdef HAVE_LIBEXIF
 	newfile->ed = NULL;
 #endif
@@ -64,21 +190,28 @@ feh_file *feh_file_new(char *filename)
 
 void feh_file_free(feh_file * file)
 {
+	feh_file_block *block;
+
 	if (!file)
 		return;
-	if (file->filename)
-		free(file->filename);
-	if (file->name)
-		free(file->name);
 	if (file->caption)
 		free(file->caption);
 	if (file->info)
 		feh_file_info_free(file->info);
+	if (file->listed_info)
+		feh_file_info_free(file->listed_info);
 #ifdef HAVE_LIBEXIF
 	if (file->ed)
 		exif_data_unref(file->ed);
 #endif		
-	free(file);
+
+	block = FILE_BLOCK(file);
+	if (--block->live == 0) {
+		if (block == file_block)
+			block->used = FILE_BLOCK_HEADER;
+		else
+			free(block);
+	}
 	return;
 }
 
@@ -92,8 +225,10 @@ feh_file_info *feh_file_info_new(void)
 	info->width = 0;
 	info->height = 0;
 	info->size = 0;
+	info->mtime_ns = 0;
 	info->pixels = 0;
 	info->has_alpha = 0;
+	info->probed = 0;
 	info->format = NULL;
 	info->extension = NULL;
 
@@ -120,15 +255,138 @@ gib_list *feh_file_rm_and_free(gib_list * list, gib_list * l)
 
 gib_list *feh_file_remove_from_list(gib_list * list, gib_list * l)
 {
+	winwidget_forget_file(l);
+	feh_prefetch_forget(l);
+	feh_watch_forget(l);
+	feh_filelist_index_remove(l);
 	feh_file_free(FEH_FILE(l->data));
 	D(("filelist_len %d -> %d\n", filelist_len, filelist_len - 1));
 	filelist_len--;
 	return(gib_list_remove(list, l));
 }
 
-int file_selector_all(const struct dirent *unused __attribute__((unused)))
+void feh_filelist_changed(void)
+{
+	filelist_index_valid = 0;
+	return;
+}
+
+/* Count the files in the index slots, now that the first hole appears */
+static void feh_filelist_tree_build(void)
+{
+	int i, parent;
+
+	filelist_index_tree = erealloc(filelist_index_tree,
+			(filelist_index_size + 1) * sizeof(int));
+	for (i = 1; i <= filelist_index_len; i++)
+		filelist_index_tree[i] = 1;
+	for (i = 1; i <= filelist_index_len; i++)
+		if ((parent = i + (i & -i)) <= filelist_index_len)
+			filelist_index_tree[parent] += filelist_index_tree[i];
+	return;
+}
+
+/* Number of files in the slots before slot */
+static int feh_filelist_tree_rank(int slot)
+{
+	int count = 0;
+
+	for (; slot > 0; slot -= slot & -slot)
+		count += filelist_index_tree[slot];
+	return(count);
+}
+
+/* Slot of the file at position pos */
+static int feh_filelist_tree_select(int pos)
+{
+	int slot = 0, step = 1;
+
+	while (step * 2 <= filelist_index_len)
+		step *= 2;
+	for (; step; step /= 2) {
+		if ((slot + step <= filelist_index_len)
+				&& (filelist_index_tree[slot + step] <= pos)) {
+			slot += step;
+			pos -= filelist_index_tree[slot];
+		}
+	}
+	return(slot);
+}
+
+/* Leave a hole where l was in the index, if it is in there */
+static void feh_filelist_index_remove(gib_list * l)
 {
-  return 1;
+	int slot = FEH_FILE(l->data)->list_pos;
+	int i;
+
+	if (!filelist_index_valid || (slot < 0) || (slot >= filelist_index_len)
+			|| (filelist_index[slot] != l))
+		return;
+
+	if (!filelist_index_holes++)
+		feh_filelist_tree_build();
+	filelist_index[slot] = NULL;
+	for (i = slot + 1; i <= filelist_index_len; i += i & -i)
+		filelist_index_tree[i]--;
+	return;
+}
+
+static void feh_filelist_index_update(void)
+{
+	gib_list *l;
+	int i = 0;
+
+	if (filelist_index_valid && (filelist_index_holes * 4 <= filelist_index_len))
+		return;
+
+	for (l = filelist; l; l = l->next) {
+		if (i == filelist_index_size) {
+			filelist_index_size = filelist_index_size ? filelist_index_size * 2 : 1024;
+			filelist_index = erealloc(filelist_index,
+					filelist_index_size * sizeof(gib_list *));
+		}
+		filelist_index[i] = l;
+		FEH_FILE(l->data)->list_pos = i;
+		i++;
+	}
+	filelist_index_len = i;
+	filelist_index_valid = 1;
+	filelist_index_holes = 0;
+	return;
+}
+
+int feh_filelist_length(void)
+{
+	feh_filelist_index_update();
+	return(filelist_index_len - filelist_index_holes);
+}
+
+/* Returns the n-th entry of filelist, or NULL if there is none */
+gib_list *feh_filelist_nth(int n)
+{
+	feh_filelist_index_update();
+	if ((n < 0) || (n >= filelist_index_len - filelist_index_holes))
+		return(NULL);
+	if (filelist_index_holes)
+		n = feh_filelist_tree_select(n);
+	return(filelist_index[n]);
+}
+
+/* Returns the position of l in filelist, or -1 if it is not part of it */
+int feh_filelist_position(gib_list * l)
+{
+	int pos;
+
+	if (!l || !l->data)
+		return(-1);
+
+	feh_filelist_index_update();
+	pos = FEH_FILE(l->data)->list_pos;
+	if ((pos < 0) || (pos >= filelist_index_len) || (filelist_index[pos] != l))
+		return(-1);
+	if (filelist_index_holes)
+		pos = feh_filelist_tree_rank(pos);
+	return(pos);
 }
 
 static void feh_print_stat_error(char *path)
@@ -188,10 +446,22 @@ static void add_stdin_to_filelist()
 	fclose(outfile);
 
 	filelist = gib_list_add_front(filelist, feh_file_new(sfn));
+	feh_filelist_changed();
 	add_file_to_rm_filelist(sfn);
 	free(sfn);
 }
 
+static void add_scanned_file_to_filelist(char *path)
+{
+	/* the --stream scanner thread leaves the filelist to the main thread */
+	if (feh_stream_producing()) {
+		feh_stream_add_file(path);
+		return;
+	}
+	filelist = gib_list_add_front(filelist, feh_file_new(path));
+	feh_filelist_changed();
+	return;
+}
 
 /* Recursive */
 void add_file_to_filelist_recursively(char *origpath, unsigned char level)
@@ -215,7 +485,7 @@ void add_file_to_filelist_recursively(char *origpath, unsigned char level)
 
 		if (path_is_url(path)) {
 			D(("Adding url %s to filelist\n", path));
-			filelist = gib_list_add_front(filelist, feh_file_new(path));
+			add_scanned_file_to_filelist(path);
 			/* We'll download it later... */
 			free(path);
 			return;
@@ -239,54 +509,19 @@ void add_file_to_filelist_recursively(char *origpath, unsigned char level)
 	}
 
 	if ((S_ISDIR(st.st_mode)) && (level != FILELIST_LAST)) {
-		struct dirent **de;
-		DIR *dir;
-		int cnt, n;
+		void (*add_dir) (char *path) = NULL;
 
 		D(("It is a directory\n"));
-
-		if ((dir = opendir(path)) == NULL) {
-			if (!opt.quiet)
-				weprintf("couldn't open directory %s:", path);
-			free(path);
-			return;
-		}
-		n = scandir(path, &de, file_selector_all, alphasort);
-		
-		if (n < 0) {
-			switch (errno) {
-			case ENOMEM:
-				weprintf("Insufficient memory to scan directory %s:", path);
-				break;
-			default:
-				weprintf("Failed to scan directory %s:", path);
-			}
-		} else {
-			for (cnt = 0; cnt < n; cnt++) {
-				if (strcmp(de[cnt]->d_name, ".")
-						&& strcmp(de[cnt]->d_name, "..")) {
-					char *newfile;
-
-					newfile = estrjoin("", path, "/", de[cnt]->d_name, NULL);
-					/* This ensures we go down one level even if not fully recursive
-					   - this way "feh some_dir" expands to some_dir's contents */
-					if (opt.recursive)
-					{
-						add_file_to_filelist_recursively(newfile, FILELIST_CONTINUE);
-					}
-					else
-						add_file_to_filelist_recursively(newfile, FILELIST_LAST);
-
-					free(newfile);
-				}
-				free(de[cnt]);
-			}
-			free(de);
-		}
-		closedir(dir);
+		/* This expands "feh some_dir" to some_dir's contents even if not
+		   fully recursive */
+		/* only the slideshow applies --reload incrementally, see watch.c */
+		if ((opt.reload > 0) && feh_slideshow_selected() && !opt.filelistfile)
+			add_dir = feh_stream_producing() ? feh_stream_add_dir : feh_watch_add_dir;
+		feh_scan_directory(path, opt.recursive, add_scanned_file_to_filelist,
+				add_dir, feh_print_stat_error);
 	} else if (S_ISREG(st.st_mode)) {
 		D(("Adding regular file %s to filelist\n", path));
-		filelist = gib_list_add_front(filelist, feh_file_new(path));
+		add_scanned_file_to_filelist(path);
 	}
 	free(path);
 	return;
@@ -307,17 +542,160 @@ void delete_rm_files(void)
 	return;
 }
 
+/*
+ * Whether the infos have to come from actually loading the images. That is
+ * the point of an explicit --preload, and --list should not list images
+ * which cannot be shown. Preloads only needed for sorting or the dimension
+ * filters are happy with the image header.
+ */
+static int feh_file_info_needs_load(void)
+{
+	return(opt.preload || opt.list || opt.customlist);
+}
+
+/* Whether info may stand in for loading the image */
+static int feh_file_info_is_trusted(feh_file_info * info)
+{
+	return(!info->probed || !feh_file_info_needs_load());
+}
+
+/* Whether info (e.g. from a binary filelist) still describes the file with status st */
+static int feh_file_info_is_current(feh_file_info * info, struct stat *st)
+{
+	if (!info || !feh_file_info_is_trusted(info))
+		return(0);
+	if (info->mtime_ns && (info->size == st->st_size)
+			&& (info->mtime_ns == st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec))
+		return(1);
+	return(0);
+}
+
+static void *feh_file_info_preload_worker(void *arg)
+{
+	preload_job *job;
+
+	(void) arg;
+
+	for (;;) {
+		pthread_mutex_lock(&preload_lock);
+		if (preload_next_job == preload_job_count) {
+			pthread_mutex_unlock(&preload_lock);
+			return(NULL);
+		}
+		job = &preload_jobs[preload_next_job++];
+		pthread_mutex_unlock(&preload_lock);
+
+		if (stat(job->file->filename, &job->st))
+			job->stat_errno = errno;
+		else if (feh_file_info_is_current(job->file->info, &job->st))
+			job->cached = 1;
+		else if (feh_file_info_is_current(job->file->listed_info, &job->st)) {
+			feh_file_info_free(job->file->info);
+			job->file->info = job->file->listed_info;
+			job->file->listed_info = NULL;
+			job->cached = 1;
+		} else {
+			if (job->file->info) {
+				feh_file_info_free(job->file->info);
+				job->file->info = NULL;
+			}
+			if (job->file->listed_info) {
+				feh_file_info_free(job->file->listed_info);
+				job->file->listed_info = NULL;
+			}
+			if (feh_info_cache_get(&job->st, job->file)) {
+				if (feh_file_info_is_trusted(job->file->info))
+					job->cached = 1;
+				else {
+					feh_file_info_free(job->file->info);
+					job->file->info = NULL;
+				}
+			}
+			if (!job->cached && !feh_file_info_needs_load()) {
+				job->probed = feh_file_info_new();
+				if (!feh_probe_image_info(job->file->filename, job->probed)) {
+					feh_file_info_free(job->probed);
+					job->probed = NULL;
+				}
+			}
+		}
+
+		pthread_mutex_lock(&preload_lock);
+		job->done = 1;
+		pthread_cond_broadcast(&preload_done_cond);
+		pthread_mutex_unlock(&preload_lock);
+	}
+}
+
+/*
+ * Load the info of every file in list and drop the ones which cannot be
+ * loaded or are outside the --min-dimension / --max-dimension bounds.
+ *
+ * The I/O bound part (stat, --info-cache and header lookups) is spread over
+ * one thread per core. Header lookups are skipped if the images have to be
+ * loaded anyway, see feh_file_info_needs_load. Images whose header we do not understand still have
+ * to be decoded, which Imlib2 only allows on the main thread. Results are
+ * consumed in list order, so progress output and error messages appear just
+ * like they would for a sequential run.
+ */
 gib_list *feh_file_info_preload(gib_list * list)
 {
 	gib_list *l;
 	feh_file *file = NULL;
 	gib_list *remove_list = NULL;
+	pthread_t threads[PRELOAD_THREADS_MAX];
+	preload_job *job;
+	long cpus;
+	int i, failed, thread_count = 0;
 
 	int time_count = 1;
-	for (l = list; l; l = l->next) {
+
+	preload_job_count = 0;
+	for (l = list; l; l = l->next)
+		preload_job_count++;
+	preload_jobs = emalloc((preload_job_count + 1) * sizeof(preload_job));
+	memset(preload_jobs, 0, (preload_job_count + 1) * sizeof(preload_job));
+	for (l = list, i = 0; l; l = l->next, i++)
+		preload_jobs[i].file = FEH_FILE(l->data);
+	preload_next_job = 0;
+
+	feh_info_cache_open();
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus > PRELOAD_THREADS_MAX)
+		cpus = PRELOAD_THREADS_MAX;
+	if (cpus > preload_job_count)
+		cpus = preload_job_count;
+	for (i = 0; i < cpus; i++)
+		if (pthread_create(&threads[thread_count], NULL,
+					feh_file_info_preload_worker, NULL) == 0)
+			thread_count++;
+	if ((thread_count == 0) && preload_job_count)
+		feh_file_info_preload_worker(NULL);
+
+	for (l = list, job = preload_jobs; l; l = l->next, job++) {
 		file = FEH_FILE(l->data);
 		D(("file %p, file->next %p, file->name %s\n", l, l->next, file->name));
-		if (feh_file_info_load_count(file, NULL,time_count)) {
+
+		pthread_mutex_lock(&preload_lock);
+		while (!job->done)
+			pthread_cond_wait(&preload_done_cond, &preload_lock);
+		pthread_mutex_unlock(&preload_lock);
+
+		failed = 0;
+		if (job->stat_errno) {
+			errno = job->stat_errno;
+			feh_print_stat_error(file->filename);
+			failed = 1;
+		} else if (job->cached)
+			file->info->time = time_count;
+		else if (job->probed) {
+			feh_file_info_set_probed(file, &job->st, job->probed);
+			file->info->time = time_count;
+		} else
+			failed = feh_file_info_load_count(file, NULL, time_count);
+
+		if (failed) {
 			D(("Failed to load file %p\n", file));
 			remove_list = gib_list_add_front(remove_list, l);
 			if (opt.verbose)
@@ -338,14 +716,23 @@ gib_list *feh_file_info_preload(gib_list * list)
 		time_count++;
 	}
 
+	for (i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+	free(preload_jobs);
+	preload_jobs = NULL;
+	preload_job_count = 0;
+
 	if (opt.verbose)
 		feh_display_status(0);
 
+	feh_info_cache_save();
+
 	if (remove_list) {
 		for (l = remove_list; l; l = l->next) {
 			feh_file_free(FEH_FILE(((gib_list *) l->data)->data));
 			filelist = list = gib_list_remove(list, (gib_list *) l->data);
 		}
+		feh_filelist_changed();
 
 		gib_list_free(remove_list);
 	}
@@ -354,6 +741,45 @@ gib_list *feh_file_info_preload(gib_list * list)
 }
 
 
+/* Complete info as returned by feh_probe_image_info and attach it to file */
+static void feh_file_info_set_probed(feh_file * file, struct stat *st, feh_file_info * info)
+{
+	info->pixels = info->width * info->height;
+	info->probed = 1;
+	info->size = st->st_size;
+	info->mtime_ns = st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+	file->info = info;
+	feh_info_cache_put(st, info);
+	return;
+}
+
+/*
+ * Get the info for file without decoding it, either from --info-cache or from
+ * the image header. Returns 1 on success.
+ */
+static int feh_file_info_lookup(feh_file * file, struct stat *st)
+{
+	feh_file_info *info;
+
+	if (feh_info_cache_get(st, file)) {
+		if (feh_file_info_is_trusted(file->info))
+			return(1);
+		feh_file_info_free(file->info);
+		file->info = NULL;
+	}
+	if (feh_file_info_needs_load())
+		return(0);
+
+	info = feh_file_info_new();
+	if (!feh_probe_image_info(file->filename, info)) {
+		feh_file_info_free(info);
+		return(0);
+	}
+
+	feh_file_info_set_probed(file, st, info);
+	return(1);
+}
+
 int feh_file_info_load(feh_file * file, Imlib_Image im)
 {
 	struct stat st;
@@ -371,6 +797,9 @@ int feh_file_info_load(feh_file * file, Imlib_Image im)
 		return(1);
 	}
 
+	if (!im && feh_file_info_lookup(file, &st))
+		return(0);
+
 	if (im)
 		im1 = im;
 	else if (!feh_load_image(&im1, file) || !im1)
@@ -388,6 +817,8 @@ int feh_file_info_load(feh_file * file, Imlib_Image im)
 	file->info->format = estrdup(gib_imlib_image_format(im1));
 
 	file->info->size = st.st_size;
+	file->info->mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	feh_info_cache_put(&st, file->info);
 
 	if (need_free)
 		gib_imlib_free_image_and_decache(im1);
@@ -412,6 +843,11 @@ int feh_file_info_load_count(feh_file * file, Imlib_Image im, int time_count)
 		return(1);
 	}
 
+	if (!im && feh_file_info_lookup(file, &st)) {
+		file->info->time = time_count;
+		return(0);
+	}
+
 	if (im)
 		im1 = im;
 	else if (!feh_load_image(&im1, file) || !im1)
@@ -431,6 +867,8 @@ int feh_file_info_load_count(feh_file * file, Imlib_Image im, int time_count)
 	file->info->format = estrdup(gib_imlib_image_format(im1));
 
 	file->info->size = st.st_size;
+	file->info->mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	feh_info_cache_put(&st, file->info);
 
 	if (need_free)
 		gib_imlib_free_image_and_decache(im1);
@@ -520,7 +958,10 @@ int feh_cmp_pixels(void *file1, void *file2)
 
 int feh_cmp_size(void *file1, void *file2)
 {
-	return((FEH_FILE(file1)->info->size - FEH_FILE(file2)->info->size));
+	long long size1 = FEH_FILE(file1)->info->size;
+	long long size2 = FEH_FILE(file2)->info->size;
+
+	return((size1 > size2) - (size1 < size2));
 }
 
 int feh_cmp_format(void *file1, void *file2)
@@ -528,6 +969,342 @@ int feh_cmp_format(void *file1, void *file2)
 	return(strcmp(FEH_FILE(file1)->info->format, FEH_FILE(file2)->info->format));
 }
 
+/*
+ * Sorting the filelist.
+ *
+ * gib_list_sort calls the feh_cmp_* functions O(n log n) times, and some of
+ * them are expensive: feh_cmp_mtime stats both files and feh_cmp_dirname
+ * copies both directory names. feh_filelist_sort instead extracts the key
+ * of every file once, sorts an array of keys with a stable merge sort (in
+ * parallel for long lists) and relinks the list in one pass. It gives the
+ * same order as gib_list_sort with the matching feh_cmp_* function, except
+ * that files which compare equal keep their relative order.
+ */
+
+/* use several threads for lists of at least this many files */
+#define SORT_PARALLEL_MIN 32768
+
+/* must be a power of two */
+#define SORT_THREADS_MAX 16
+
+/* runs of this length are sorted by insertion before merging */
+#define SORT_RUN 16
+
+typedef struct {
+	gib_list *node;
+	const char *str;	/* name, filename, directory or format */
+	const char *name;	/* tie breaker for directories */
+	long long num;	/* mtime, width, height, pixels or size */
+	int stat_errno;
+	int owns_str;
+} sort_key;
+
+typedef int (*sort_key_cmp) (const sort_key *, const sort_key *);
+
+typedef struct {
+	sort_key *keys;
+	sort_key *tmp;
+	int start;
+	int mid;
+	int end;
+	sort_key_cmp cmp;
+} sort_task;
+
+static int feh_sort_cmp_str(const sort_key * k1, const sort_key * k2)
+{
+	return(strcmp_or_strverscmp(k1->str, k2->str));
+}
+
+static int feh_sort_cmp_dirname(const sort_key * k1, const sort_key * k2)
+{
+	int cmp;
+
+	/* directory names are shared between adjacent files */
+	if ((k1->str != k2->str) && ((cmp = strcmp_or_strverscmp(k1->str, k2->str)) != 0))
+		return(cmp);
+	return(strcmp_or_strverscmp(k1->name, k2->name));
+}
+
+static int feh_sort_cmp_format(const sort_key * k1, const sort_key * k2)
+{
+	return(strcmp(k1->str, k2->str));
+}
+
+static int feh_sort_cmp_num(const sort_key * k1, const sort_key * k2)
+{
+	return((k1->num > k2->num) - (k1->num < k2->num));
+}
+
+/* newest first */
+static int feh_sort_cmp_mtime(const sort_key * k1, const sort_key * k2)
+{
+	return((k1->num < k2->num) - (k1->num > k2->num));
+}
+
+/* Stable merge of [start, mid) and [mid, end) of src into dst */
+static void feh_sort_merge(sort_key * src, sort_key * dst, int start, int mid,
+		int end, sort_key_cmp cmp)
+{
+	int i = start, j = mid, k = start;
+
+	while ((i < mid) && (j < end)) {
+		if (cmp(&src[j], &src[i]) < 0)
+			dst[k++] = src[j++];
+		else
+			dst[k++] = src[i++];
+	}
+	memcpy(&dst[k], &src[i], (mid - i) * sizeof(sort_key));
+	k += mid - i;
+	memcpy(&dst[k], &src[j], (end - j) * sizeof(sort_key));
+	return;
+}
+
+/* Bottom-up merge sort of keys[start, end); tmp is scratch space of the same size */
+static void feh_sort_range(sort_key * keys, sort_key * tmp, int start, int end,
+		sort_key_cmp cmp)
+{
+	sort_key *src = keys, *dst = tmp, *swap;
+	sort_key key;
+	int i, j, run, width;
+
+	for (run = start; run < end; run += SORT_RUN) {
+		for (i = run + 1; (i < run + SORT_RUN) && (i < end); i++) {
+			key = keys[i];
+			for (j = i; (j > run) && (cmp(&key, &keys[j - 1]) < 0); j--)
+				keys[j] = keys[j - 1];
+			keys[j] = key;
+		}
+	}
+
+	for (width = SORT_RUN; width < end - start; width *= 2) {
+		for (i = start; i < end; i += 2 * width) {
+			int mid = (i + width < end) ? i + width : end;
+			int stop = (i + 2 * width < end) ? i + 2 * width : end;
+
+			feh_sort_merge(src, dst, i, mid, stop, cmp);
+		}
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if (src != keys)
+		memcpy(&keys[start], &src[start], (end - start) * sizeof(sort_key));
+	return;
+}
+
+static void *feh_sort_range_worker(void *arg)
+{
+	sort_task *task = arg;
+
+	feh_sort_range(task->keys, task->tmp, task->start, task->end, task->cmp);
+	return(NULL);
+}
+
+static void *feh_sort_merge_worker(void *arg)
+{
+	sort_task *task = arg;
+
+	feh_sort_merge(task->keys, task->tmp, task->start, task->mid, task->end, task->cmp);
+	return(NULL);
+}
+
+static void *feh_sort_mtime_worker(void *arg)
+{
+	sort_task *task = arg;
+	struct stat st;
+	int i;
+
+	for (i = task->start; i < task->end; i++) {
+		sort_key *key = &task->keys[i];
+
+		if (stat(FEH_FILE(key->node->data)->filename, &st)) {
+			key->stat_errno = errno;
+			key->num = LLONG_MIN;
+		} else
+			key->num = st.st_mtime;
+	}
+	return(NULL);
+}
+
+/* Run count tasks at once; falls back to the calling thread if need be */
+static void feh_sort_run_tasks(void *(*worker)(void *), sort_task * tasks, int count)
+{
+	pthread_t threads[SORT_THREADS_MAX];
+	int started[SORT_THREADS_MAX];
+	int i;
+
+	for (i = 1; i < count; i++)
+		started[i] = (pthread_create(&threads[i], NULL, worker, &tasks[i]) == 0);
+	worker(&tasks[0]);
+	for (i = 1; i < count; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			worker(&tasks[i]);
+	}
+	return;
+}
+
+gib_list *feh_filelist_sort(gib_list * list, int mode)
+{
+	sort_task tasks[SORT_THREADS_MAX];
+	int bounds[SORT_THREADS_MAX + 1];
+	sort_key *keys, *tmp, *swap;
+	sort_key_cmp cmp;
+	feh_file *file;
+	gib_list *l;
+	long cpus;
+	int i, n, chunks, width;
+
+	switch (mode) {
+	case SORT_NAME:
+	case SORT_FILENAME:
+		cmp = feh_sort_cmp_str;
+		break;
+	case SORT_DIRNAME:
+		cmp = feh_sort_cmp_dirname;
+		break;
+	case SORT_MTIME:
+		cmp = feh_sort_cmp_mtime;
+		break;
+	case SORT_WIDTH:
+	case SORT_HEIGHT:
+	case SORT_PIXELS:
+	case SORT_SIZE:
+		cmp = feh_sort_cmp_num;
+		break;
+	case SORT_FORMAT:
+		cmp = feh_sort_cmp_format;
+		break;
+	default:
+		return(list);
+	}
+
+	for (n = 0, l = list; l; l = l->next)
+		n++;
+	if (n < 2)
+		return(list);
+
+	keys = emalloc(n * sizeof(sort_key));
+	tmp = emalloc(n * sizeof(sort_key));
+	memset(keys, 0, n * sizeof(sort_key));
+
+	chunks = 1;
+	if (n >= SORT_PARALLEL_MIN) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		while ((chunks * 2 <= cpus) && (chunks < SORT_THREADS_MAX))
+			chunks *= 2;
+	}
+	for (i = 0; i <= chunks; i++)
+		bounds[i] = (long long) n * i / chunks;
+	for (i = 0; i < chunks; i++) {
+		tasks[i].keys = keys;
+		tasks[i].tmp = tmp;
+		tasks[i].start = bounds[i];
+		tasks[i].end = bounds[i + 1];
+		tasks[i].cmp = cmp;
+	}
+
+	for (i = 0, l = list; l; l = l->next, i++) {
+		file = FEH_FILE(l->data);
+		keys[i].node = l;
+		switch (mode) {
+		case SORT_NAME:
+			keys[i].str = file->name;
+			break;
+		case SORT_FILENAME:
+			keys[i].str = file->filename;
+			break;
+		case SORT_DIRNAME:
+			keys[i].name = file->name;
+			width = strlen(file->filename) - strlen(file->name);
+			if ((width <= 0) || (width >= PATH_MAX))
+				keys[i].str = "";
+			else if (i && *keys[i - 1].str
+					&& !strncmp(keys[i - 1].str, file->filename, width)
+					&& (keys[i - 1].str[width] == '\0')) {
+				/* files from one directory tend to be adjacent */
+				keys[i].str = keys[i - 1].str;
+			} else {
+				char *dir = emalloc(width + 1);
+
+				memcpy(dir, file->filename, width);
+				dir[width] = '\0';
+				keys[i].str = dir;
+				keys[i].owns_str = 1;
+			}
+			break;
+		case SORT_WIDTH:
+			keys[i].num = file->info->width;
+			break;
+		case SORT_HEIGHT:
+			keys[i].num = file->info->height;
+			break;
+		case SORT_PIXELS:
+			keys[i].num = file->info->pixels;
+			break;
+		case SORT_SIZE:
+			keys[i].num = file->info->size;
+			break;
+		case SORT_FORMAT:
+			keys[i].str = file->info->format;
+			break;
+		}
+	}
+
+	if (mode == SORT_MTIME) {
+		feh_sort_run_tasks(feh_sort_mtime_worker, tasks, chunks);
+		for (i = 0; i < n; i++) {
+			if (keys[i].stat_errno) {
+				errno = keys[i].stat_errno;
+				feh_print_stat_error(FEH_FILE(keys[i].node->data)->filename);
+			}
+		}
+	}
+
+	feh_sort_run_tasks(feh_sort_range_worker, tasks, chunks);
+
+	/* merge sorted chunks pairwise until one is left */
+	for (width = 1; width < chunks; width *= 2) {
+		int count = 0;
+
+		for (i = 0; i < chunks; i += 2 * width) {
+			tasks[count].keys = keys;
+			tasks[count].tmp = tmp;
+			tasks[count].start = bounds[i];
+			tasks[count].mid = bounds[i + width];
+			tasks[count].end = bounds[i + 2 * width];
+			tasks[count].cmp = cmp;
+			count++;
+		}
+		feh_sort_run_tasks(feh_sort_merge_worker, tasks, count);
+		swap = keys;
+		keys = tmp;
+		tmp = swap;
+	}
+
+	for (i = 0; i < n; i++) {
+		keys[i].node->prev = i ? keys[i - 1].node : NULL;
+		keys[i].node->next = (i + 1 < n) ? keys[i + 1].node : NULL;
+	}
+	list = keys[0].node;
+
+	for (i = 0; i < n; i++)
+		if (keys[i].owns_str)
+			free((char *) keys[i].str);
+	free(keys);
+	free(tmp);
+	return(list);
+}
+
+/* Whether feh_prepare_filelist needs to load the file infos */
+int feh_filelist_needs_preload(void)
+{
+	return(opt.list || opt.preload || opt.customlist || (opt.sort > SORT_MTIME)
+			|| (opt.filter_by_dimensions && (opt.index || opt.thumbs || opt.bgmode)));
+}
+
 void feh_prepare_filelist(void)
 {
 	/*
@@ -539,8 +1316,7 @@ void feh_prepare_filelist(void)
 	 * is set and we're in thumbnail mode, we need to filter images first so
 	 * we can create a properly sized thumbnail list.
 	 */
-	if (opt.list || opt.preload || opt.customlist || (opt.sort > SORT_MTIME)
-			|| (opt.filter_by_dimensions && (opt.index || opt.thumbs || opt.bgmode))) {
+	if (feh_filelist_needs_preload()) {
 		/* For these sort options, we have to preload images */
 		filelist = feh_file_info_preload(filelist);
 		if (!gib_list_length(filelist))
@@ -550,42 +1326,18 @@ void feh_prepare_filelist(void)
 	D(("sort mode requested is: %d\n", opt.sort));
 	switch (opt.sort) {
 	case SORT_NONE:
-		if (opt.randomize) {
+		if (opt.randomize && !feh_pic_slots_shuffled()) {
 			/* Randomize the filename order */
 			filelist = gib_list_randomize(filelist);
-		} else if (!opt.reverse) {
-			/* Let's reverse the list. Its back-to-front right now ;) */
+		} else if (!opt.reverse || opt.randomize) {
+			/* Let's reverse the list. Its back-to-front right now ;)
+			   A timed slideshow randomizes its slots instead, see timers.c */
 			filelist = gib_list_reverse(filelist);
 		}
 		break;
-	case SORT_NAME:
-		filelist = gib_list_sort(filelist, feh_cmp_name);
-		break;
-	case SORT_FILENAME:
-		filelist = gib_list_sort(filelist, feh_cmp_filename);
-		break;
-	case SORT_DIRNAME:
-		filelist = gib_list_sort(filelist, feh_cmp_dirname);
-		break;
-	case SORT_MTIME:
-		filelist = gib_list_sort(filelist, feh_cmp_mtime);
-		break;
-	case SORT_WIDTH:
-		filelist = gib_list_sort(filelist, feh_cmp_width);
-		break;
-	case SORT_HEIGHT:
-		filelist = gib_list_sort(filelist, feh_cmp_height);
-		break;
-	case SORT_PIXELS:
-		filelist = gib_list_sort(filelist, feh_cmp_pixels);
-		break;
-	case SORT_SIZE:
-		filelist = gib_list_sort(filelist, feh_cmp_size);
-		break;
-	case SORT_FORMAT:
-		filelist = gib_list_sort(filelist, feh_cmp_format);
-		break;
 	default:
+		/* sort in command line order, which decides the order of equal keys */
+		filelist = feh_filelist_sort(gib_list_reverse(filelist), opt.sort);
 		break;
 	}
 
@@ -595,6 +1347,7 @@ void feh_prepare_filelist(void)
 		filelist = gib_list_reverse(filelist);
 	}
 
+	feh_filelist_changed();
 	return;
 }
 
@@ -602,10 +1355,19 @@ int feh_write_filelist(gib_list * list, char *filename)
 {
 	FILE *fp;
 	gib_list *l;
+	int binary;
 
 	if (!list || !filename || !strcmp(filename, "/dev/stdin"))
 		return(0);
 
+	/* unless told otherwise, a filelist keeps the format it was read in */
+	if (opt.filelist_format == FILELIST_FORMAT_KEEP)
+		binary = binary_filelist && !strcmp(filename, binary_filelist);
+	else
+		binary = (opt.filelist_format == FILELIST_FORMAT_BINARY);
+	if (binary)
+		return(feh_binlist_write(list, filename));
+
 	errno = 0;
 	if ((fp = fopen(filename, "w")) == NULL) {
 		weprintf("can't write filelist %s:", filename);
@@ -624,7 +1386,9 @@ gib_list *feh_read_filelist(char *filename)
 {
 	FILE *fp;
 	gib_list *list = NULL;
-	char s[1024], s1[1024];
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
 	Imlib_Load_Error err = IMLIB_LOAD_ERROR_NONE;
 	Imlib_Image tmp_im;
 	struct stat st;
@@ -633,6 +1397,15 @@ gib_list *feh_read_filelist(char *filename)
 	if (!filename)
 		return(NULL);
 
+	if (strcmp(filename, "/dev/stdin") && feh_binlist_detect(filename)) {
+		free(binary_filelist);
+		binary_filelist = estrdup(filename);
+		return(feh_binlist_read(filename));
+	} else if (binary_filelist && !strcmp(filename, binary_filelist)) {
+		free(binary_filelist);
+		binary_filelist = NULL;
+	}
+
 	/*
 	 * feh_load_image will fail horribly if filename is not seekable
 	 */
@@ -663,16 +1436,17 @@ gib_list *feh_read_filelist(char *filename)
 		return(NULL);
 	}
 
-	for (; fgets(s, sizeof(s), fp);) {
-		D(("Got line '%s'\n", s));
-		s1[0] = '\0';
-		sscanf(s, "%[^\n]", (char *) &s1);
-		if (!(*s1) || (*s1 == '\n'))
+	while ((len = getline(&line, &line_size, fp)) != -1) {
+		D(("Got line '%s'\n", line));
+		if (len && (line[len - 1] == '\n'))
+			line[--len] = '\0';
+		if (!len)
 			continue;
-		D(("Got filename %s from filelist file\n", s1));
+		D(("Got filename %s from filelist file\n", line));
 		/* Add it to the new list */
-		list = gib_list_add_front(list, feh_file_new(s1));
+		list = gib_list_add_front(list, feh_file_new(line));
 	}
+	free(line);
 	if (strcmp(filename, "/dev/stdin"))
 		fclose(fp);
 
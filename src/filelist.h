@@ -37,6 +37,11 @@ struct __feh_file {
 
 	/* info stuff */
 	feh_file_info *info;	/* only set when needed */
+	/* info from a binary filelist, not checked against the file yet */
+	feh_file_info *listed_info;
+
+	/* slot in the filelist index, valid while the index is */
+	int list_pos;
 #ifdef HAVE_LIBEXIF
 	ExifData *ed;
 #endif
@@ -45,12 +50,18 @@ struct __feh_file {
 struct __feh_file_info {
 	int width;
 	int height;
-	int size;
+	long long size;
 	int pixels;
         int time;
 	unsigned char has_alpha;
 	char *format;
 	char *extension;
+
+	/* mtime of the file the info was read from, 0 if unknown */
+	long long mtime_ns;
+
+	/* read from the image header only, the image may still not load */
+	unsigned char probed;
 };
 
 #define FEH_FILE(l) ((feh_file *) l)
@@ -85,7 +96,6 @@ void feh_file_free(feh_file * file);
 feh_file_info *feh_file_info_new(void);
 void feh_file_info_free(feh_file_info * info);
 gib_list *feh_file_rm_and_free(gib_list * list, gib_list * file);
-int file_selector_all(const struct dirent *unused);
 void add_file_to_filelist_recursively(char *origpath, unsigned char level);
 void add_file_to_rm_filelist(char *file);
 void delete_rm_files(void);
@@ -93,11 +103,17 @@ gib_list *feh_file_info_preload(gib_list * list);
 int feh_file_info_load(feh_file * file, Imlib_Image im);
 int feh_file_info_load_count(feh_file * file, Imlib_Image im, int time_count);
 void feh_file_dirname(char *dst, feh_file * f, int maxlen);
+gib_list *feh_filelist_sort(gib_list * list, int mode);
+int feh_filelist_needs_preload(void);
 void feh_prepare_filelist(void);
 int feh_write_filelist(gib_list * list, char *filename);
 gib_list *feh_read_filelist(char *filename);
 char *feh_absolute_path(char *path);
 gib_list *feh_file_remove_from_list(gib_list * list, gib_list * l);
+void feh_filelist_changed(void);
+int feh_filelist_length(void);
+gib_list *feh_filelist_nth(int n);
+int feh_filelist_position(gib_list * l);
 void feh_save_filelist();
 
 int feh_cmp_name(void *file1, void *file2);
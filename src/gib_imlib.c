@@ -113,6 +113,13 @@ gib_imlib_image_has_alpha(Imlib_Image im)
    return imlib_image_has_alpha();
 }
 
+void
+gib_imlib_image_decode(Imlib_Image im)
+{
+   imlib_context_set_image(im);
+   imlib_image_get_data_for_reading_only();
+}
+
 void
 gib_imlib_free_image_and_decache(Imlib_Image im)
 {
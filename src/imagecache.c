@@ -0,0 +1,443 @@
+/* imagecache.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "winwidget.h"
+#include "imagecache.h"
+#include "metrics.h"
+
+/*
+ * Decoded images, kept around after they were shown so that coming back to
+ * a slide does not mean decoding it again.
+ *
+ * Images are checked out of the cache by feh_load_image and checked back
+ * in by feh_image_cache_put once their user (usually a window) is done with
+ * them. Every image loaded from a regular file carries its origin as Imlib2
+ * attached data: the file name as well as the file's size and modification
+ * time when it was loaded. Entries are keyed by that origin rather than by
+ * whichever file the image's user points at, so changes on disk are never
+ * hidden. Images modified in memory lose their origin and are not cached.
+ * The total size of all cached images is limited to --cache-size MiB; when
+ * it is exceeded, the least recently used images go first.
+ */
+
+#define IMAGE_ORIGIN_KEY "feh_origin"
+
+typedef struct {
+	char *filename;
+	long long mtime_ns;
+	off_t size;
+} image_origin;
+
+typedef struct __cache_entry cache_entry;
+
+struct __cache_entry {
+	char *filename;
+	long long mtime_ns;
+	off_t size;
+	Imlib_Image im;
+	size_t bytes;
+	cache_entry *prev, *next;
+};
+
+/* most recently used first */
+static cache_entry *cache_head = NULL;
+static cache_entry *cache_tail = NULL;
+static size_t cache_bytes = 0;
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+
+/*
+ * Rendered frames: an image scaled and placed exactly as it appears in a
+ * window of a given size, before any overlays are drawn on top. Showing a
+ * slide again at the same geometry is then a single XCopyArea instead of
+ * another antialiased scale. Frames are kept as pixmaps on the X server,
+ * at most --frame-cache of them, and only for windows whose size does not
+ * depend on the image (full screen or --geometry).
+ */
+
+typedef struct __frame_entry frame_entry;
+
+struct __frame_entry {
+	char *filename;
+	long long mtime_ns;
+	off_t size;
+	int w, h, im_x, im_y;
+	double zoom;
+	int antialias;
+	Pixmap pmap;
+	frame_entry *prev, *next;
+};
+
+/* most recently used first */
+static frame_entry *frame_head = NULL;
+static frame_entry *frame_tail = NULL;
+static int frame_count = 0;
+static GC frame_gc = None;
+
+static size_t feh_image_cache_budget(void)
+{
+	return((size_t) opt.cache_size * 1024 * 1024);
+}
+
+static void feh_image_cache_unlink(cache_entry *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		cache_head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		cache_tail = e->prev;
+	cache_bytes -= e->bytes;
+	return;
+}
+
+/* Remove e from the cache and return its image */
+static Imlib_Image feh_image_cache_remove(cache_entry *e)
+{
+	Imlib_Image im = e->im;
+
+	feh_image_cache_unlink(e);
+	free(e->filename);
+	free(e);
+	return(im);
+}
+
+static void feh_image_origin_free(void *im __attribute__((unused)), void *data)
+{
+	image_origin *origin = data;
+
+	free(origin->filename);
+	free(origin);
+	return;
+}
+
+static image_origin *feh_image_origin(Imlib_Image im)
+{
+	Imlib_Image old = imlib_context_get_image();
+	image_origin *origin;
+
+	imlib_context_set_image(im);
+	origin = imlib_image_get_attached_data(IMAGE_ORIGIN_KEY);
+	imlib_context_set_image(old);
+	return(origin);
+}
+
+static cache_entry *feh_image_cache_find(char *filename)
+{
+	cache_entry *e;
+
+	for (e = cache_head; e; e = e->next)
+		if (!strcmp(e->filename, filename))
+			return(e);
+	return(NULL);
+}
+
+/*
+ * Returns 1 and checks out the cached image for file if it is still up to
+ * date. In any case, stamp receives the file's current size and mtime, for
+ * feh_image_cache_stamp once the image has been loaded.
+ */
+int feh_image_cache_get(Imlib_Image *im, feh_file *file, feh_image_stamp *stamp)
+{
+	struct stat st;
+	cache_entry *e;
+	long long start;
+	int ret;
+
+	stamp->mtime_ns = 0;
+	stamp->size = 0;
+
+	/* URLs are fetched anew every time, and there is nothing to stat */
+	if (!opt.cache_size || path_is_url(file->filename))
+		return(0);
+
+	start = feh_metric_now();
+	ret = stat(file->filename, &st);
+	feh_metric_record(METRIC_STAT, start);
+	if (ret || !S_ISREG(st.st_mode))
+		return(0);
+
+	stamp->mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	stamp->size = st.st_size;
+
+	if (!(e = feh_image_cache_find(file->filename))) {
+		cache_misses++;
+		return(0);
+	}
+
+	if ((e->mtime_ns != stamp->mtime_ns) || (e->size != stamp->size)) {
+		D(("%s changed on disk, dropping cached image\n", file->filename));
+		gib_imlib_free_image_and_decache(feh_image_cache_remove(e));
+		cache_misses++;
+		return(0);
+	}
+
+	D(("cache hit for %s\n", file->filename));
+	*im = feh_image_cache_remove(e);
+	cache_hits++;
+	return(1);
+}
+
+/* Records that im was just loaded from file, as it was at the time of stamp */
+void feh_image_cache_stamp(Imlib_Image im, feh_file *file, feh_image_stamp *stamp)
+{
+	Imlib_Image old = imlib_context_get_image();
+	image_origin *origin;
+
+	imlib_context_set_image(im);
+	/* Imlib2 may hand out an image it kept from an earlier load */
+	imlib_image_remove_and_free_attached_data_value(IMAGE_ORIGIN_KEY);
+	if (stamp->mtime_ns) {
+		origin = emalloc(sizeof(image_origin));
+		origin->filename = estrdup(file->filename);
+		origin->mtime_ns = stamp->mtime_ns;
+		origin->size = stamp->size;
+		imlib_image_attach_data_value(IMAGE_ORIGIN_KEY, origin, 0,
+				feh_image_origin_free);
+	}
+	imlib_context_set_image(old);
+	return;
+}
+
+/* Whether im holds the unmodified contents of file */
+int feh_image_cache_is_from(Imlib_Image im, feh_file *file)
+{
+	image_origin *origin = feh_image_origin(im);
+
+	return(origin && !strcmp(origin->filename, file->filename));
+}
+
+/* Takes ownership of im. It is either cached or freed right away. */
+void feh_image_cache_put(Imlib_Image im)
+{
+	image_origin *origin;
+	cache_entry *e;
+	size_t bytes;
+
+	if (!im)
+		return;
+
+	if (!(origin = feh_image_origin(im))) {
+		gib_imlib_free_image(im);
+		return;
+	}
+
+	bytes = (size_t) gib_imlib_image_get_width(im)
+		* gib_imlib_image_get_height(im) * sizeof(DATA32);
+
+	if (bytes > feh_image_cache_budget()) {
+		gib_imlib_free_image_and_decache(im);
+		return;
+	}
+
+	/* The same file may have been loaded twice, e.g. by the prefetcher */
+	if ((e = feh_image_cache_find(origin->filename)) != NULL)
+		gib_imlib_free_image_and_decache(feh_image_cache_remove(e));
+
+	while (cache_tail && (cache_bytes + bytes > feh_image_cache_budget())) {
+		D(("evicting %s\n", cache_tail->filename));
+		gib_imlib_free_image_and_decache(feh_image_cache_remove(cache_tail));
+	}
+
+	e = emalloc(sizeof(cache_entry));
+	e->filename = estrdup(origin->filename);
+	e->mtime_ns = origin->mtime_ns;
+	e->size = origin->size;
+	e->im = im;
+	e->bytes = bytes;
+	e->prev = NULL;
+	e->next = cache_head;
+	if (cache_head)
+		cache_head->prev = e;
+	else
+		cache_tail = e;
+	cache_head = e;
+	cache_bytes += bytes;
+	return;
+}
+
+/* im was modified in memory and must not be cached */
+void feh_image_cache_invalidate(Imlib_Image im)
+{
+	Imlib_Image old = imlib_context_get_image();
+
+	imlib_context_set_image(im);
+	imlib_image_remove_and_free_attached_data_value(IMAGE_ORIGIN_KEY);
+	imlib_context_set_image(old);
+	return;
+}
+
+void feh_image_cache_print_stats(void)
+{
+	fprintf(stderr, "image cache: %lu hits, %lu misses, %lu of %lu bytes used\n",
+			cache_hits, cache_misses, (unsigned long) cache_bytes,
+			(unsigned long) feh_image_cache_budget());
+	return;
+}
+
+static void feh_frame_cache_remove(frame_entry *f)
+{
+	if (f->prev)
+		f->prev->next = f->next;
+	else
+		frame_head = f->next;
+	if (f->next)
+		f->next->prev = f->prev;
+	else
+		frame_tail = f->prev;
+	XFreePixmap(disp, f->pmap);
+	free(f->filename);
+	free(f);
+	frame_count--;
+	return;
+}
+
+/* The origin of the slide composed in winwid, if it may come from or go into the cache */
+static image_origin *feh_frame_cache_origin(winwidget winwid)
+{
+	if ((opt.frame_cache <= 0) || !winwid->file || !winwid->im
+			|| (opt.mode != MODE_NORMAL) || winwid->has_rotated
+			|| ((winwid->type != WIN_TYPE_SLIDESHOW) && (winwid->type != WIN_TYPE_SINGLE))
+			|| !(winwid->full_screen || (opt.geom_flags & (WidthValue | HeightValue))))
+		return(NULL);
+
+	return(feh_image_origin(winwid->im));
+}
+
+static frame_entry *feh_frame_cache_find(winwidget winwid, image_origin *origin,
+		int antialias)
+{
+	frame_entry *f, *next;
+
+	for (f = frame_head; f; f = next) {
+		next = f->next;
+		if (strcmp(f->filename, origin->filename))
+			continue;
+		/* frames of an older version of the file are of no use anymore */
+		if ((f->mtime_ns != origin->mtime_ns) || (f->size != origin->size)) {
+			feh_frame_cache_remove(f);
+			continue;
+		}
+		if ((f->w == winwid->w) && (f->h == winwid->h) && (f->zoom == winwid->zoom)
+				&& (f->im_x == winwid->im_x) && (f->im_y == winwid->im_y)
+				&& (f->antialias == antialias))
+			return(f);
+	}
+	return(NULL);
+}
+
+/* Copies the cached frame for winwid's current slide into its bg_pmap, if there is one */
+int feh_frame_cache_blit(winwidget winwid, int antialias)
+{
+	image_origin *origin;
+	frame_entry *f;
+
+	if (!(origin = feh_frame_cache_origin(winwid))
+			|| !(f = feh_frame_cache_find(winwid, origin, antialias)))
+		return(0);
+
+	D(("frame cache hit for %s\n", origin->filename));
+
+	/* move to front */
+	if (f->prev) {
+		f->prev->next = f->next;
+		if (f->next)
+			f->next->prev = f->prev;
+		else
+			frame_tail = f->prev;
+		f->prev = NULL;
+		f->next = frame_head;
+		frame_head->prev = f;
+		frame_head = f;
+	}
+
+	XCopyArea(disp, f->pmap, winwid->bg_pmap, frame_gc, 0, 0, f->w, f->h, 0, 0);
+	return(1);
+}
+
+/* Remembers the slide which was just rendered into winwid's bg_pmap */
+void feh_frame_cache_store(winwidget winwid, int antialias)
+{
+	image_origin *origin;
+	frame_entry *f;
+
+	if (!(origin = feh_frame_cache_origin(winwid))
+			|| feh_frame_cache_find(winwid, origin, antialias))
+		return;
+
+	while (frame_tail && (frame_count >= opt.frame_cache))
+		feh_frame_cache_remove(frame_tail);
+
+	if (frame_gc == None)
+		frame_gc = XCreateGC(disp, winwid->win, 0, NULL);
+
+	f = emalloc(sizeof(frame_entry));
+	f->filename = estrdup(origin->filename);
+	f->mtime_ns = origin->mtime_ns;
+	f->size = origin->size;
+	f->w = winwid->w;
+	f->h = winwid->h;
+	f->zoom = winwid->zoom;
+	f->im_x = winwid->im_x;
+	f->im_y = winwid->im_y;
+	f->antialias = antialias;
+	f->pmap = XCreatePixmap(disp, winwid->win, f->w, f->h, depth);
+	XCopyArea(disp, winwid->bg_pmap, f->pmap, frame_gc, 0, 0, f->w, f->h, 0, 0);
+
+	f->prev = NULL;
+	f->next = frame_head;
+	if (frame_head)
+		frame_head->prev = f;
+	else
+		frame_tail = f;
+	frame_head = f;
+	frame_count++;
+	return;
+}
+
+/* Drops the frames of file, whose image is about to be edited */
+void feh_frame_cache_forget(feh_file *file)
+{
+	frame_entry *f, *next;
+
+	for (f = frame_head; f; f = next) {
+		next = f->next;
+		if (!strcmp(f->filename, file->filename))
+			feh_frame_cache_remove(f);
+	}
+	return;
+}
+
+void feh_frame_cache_flush(void)
+{
+	while (frame_head)
+		feh_frame_cache_remove(frame_head);
+	return;
+}
@@ -0,0 +1,47 @@
+/* imagecache.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+/* size and mtime of a file when its image is loaded */
+typedef struct {
+	long long mtime_ns;
+	off_t size;
+} feh_image_stamp;
+
+int feh_image_cache_get(Imlib_Image * im, feh_file * file, feh_image_stamp * stamp);
+void feh_image_cache_stamp(Imlib_Image im, feh_file * file, feh_image_stamp * stamp);
+int feh_image_cache_is_from(Imlib_Image im, feh_file * file);
+void feh_image_cache_put(Imlib_Image im);
+void feh_image_cache_invalidate(Imlib_Image im);
+void feh_image_cache_print_stats(void);
+
+int feh_frame_cache_blit(winwidget winwid, int antialias);
+void feh_frame_cache_store(winwidget winwid, int antialias);
+void feh_frame_cache_forget(feh_file * file);
+void feh_frame_cache_flush(void);
+
+#endif
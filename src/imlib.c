@@ -29,6 +29,9 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "signals.h"
 #include "winwidget.h"
 #include "options.h"
+#include "imagecache.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -62,6 +65,9 @@ int num_xinerama_screens;
 
 int childpid = 0;
 
+/* set by feh_load_image_quiet */
+static int load_quietly = 0;
+
 static int feh_file_is_raw(char *filename);
 static char *feh_http_load_image(char *url);
 static char *feh_dcraw_load_image(char *filename);
@@ -134,8 +140,6 @@ void init_x_and_imlib(void)
 	imlib_context_set_operation(IMLIB_OP_COPY);
 	wmDeleteWindow = XInternAtom(disp, "WM_DELETE_WINDOW", False);
 
-	imlib_set_cache_size(opt.cache_size * 1024 * 1024);
-
 	return;
 }
 
@@ -162,6 +166,20 @@ int feh_load_image_char(Imlib_Image * im, char *filename)
 	return(i);
 }
 
+/*
+ * feh_load_image for files the user has not asked to see yet (prefetching).
+ * Errors are not reported; the slideshow does that once it gets there.
+ */
+int feh_load_image_quiet(Imlib_Image * im, feh_file * file)
+{
+	int ret;
+
+	load_quietly = 1;
+	ret = feh_load_image(im, file);
+	load_quietly = 0;
+	return(ret);
+}
+
 void feh_imlib_print_load_error(char *file, winwidget w, Imlib_Load_Error err)
 {
 	if (err == IMLIB_LOAD_ERROR_OUT_OF_FILE_DESCRIPTORS)
@@ -219,21 +237,38 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 	enum { SRC_IMLIB, SRC_HTTP, SRC_MAGICK, SRC_DCRAW } image_source = SRC_IMLIB;
 	char *tmpname = NULL;
 	char *real_filename = NULL;
+	long long start, trace_load, trace_conv;
+	feh_image_stamp stamp;
 
 	D(("filename is %s, image is %p\n", file->filename, im));
 
 	if (!file || !file->filename)
 		return 0;
 
+	if (feh_image_cache_get(im, file, &stamp)) {
+#ifdef HAVE_LIBEXIF
+		if (!file->ed)
+			file->ed = exif_data_new_from_file(file->filename);
+#endif
+		return(1);
+	}
+
+	start = feh_metric_now();
+	trace_load = feh_trace_begin();
+
 	if (path_is_url(file->filename)) {
 		image_source = SRC_HTTP;
 
+		trace_conv = feh_trace_begin();
 		if ((tmpname = feh_http_load_image(file->filename)) == NULL)
 			err = IMLIB_LOAD_ERROR_FILE_DOES_NOT_EXIST;
+		feh_trace_end("http", file->filename, trace_conv);
 	}
 	else if (opt.conversion_timeout >= 0 && feh_file_is_raw(file->filename)) {
 		image_source = SRC_DCRAW;
+		trace_conv = feh_trace_begin();
 		tmpname = feh_dcraw_load_image(file->filename);
+		feh_trace_end("dcraw", file->filename, trace_conv);
 		if (!tmpname)
 			err = IMLIB_LOAD_ERROR_NO_LOADER_FOR_FILE_FORMAT;
 	}
@@ -244,7 +279,9 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 			(err == IMLIB_LOAD_ERROR_UNKNOWN) ||
 			(err == IMLIB_LOAD_ERROR_NO_LOADER_FOR_FILE_FORMAT))) {
 		image_source = SRC_MAGICK;
+		trace_conv = feh_trace_begin();
 		tmpname = feh_magick_load_image(file->filename);
+		feh_trace_end("convert", file->filename, trace_conv);
 	}
 
 	if (tmpname) {
@@ -264,7 +301,14 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 		free(tmpname);
 	}
 
+	feh_metric_record(METRIC_DECODE, start);
+	feh_trace_end("load", file->filename, trace_load);
+
 	if ((err) || (!im)) {
+		if (load_quietly) {
+			D(("Load *failed*\n"));
+			return(0);
+		}
 		if (opt.verbose && !opt.quiet) {
 			fputs("\n", stderr);
 			reset_output = 1;
@@ -286,6 +330,7 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 
 #ifdef HAVE_LIBEXIF
 	int orientation = 0;
+	start = feh_metric_now();
 	ExifData *exifData = exif_data_new_from_file(file->filename);
 	if (exifData) {
 		ExifByteOrder byteOrder = exif_data_get_byte_order(exifData);
@@ -313,8 +358,10 @@ int feh_load_image(Imlib_Image * im, feh_file * file)
 	}
 	else if (orientation == 8)
 		gib_imlib_image_orientate(*im, 3);
+	feh_metric_record(METRIC_ORIENT, start);
 #endif
 
+	feh_image_cache_stamp(*im, file, &stamp);
 	D(("Loaded ok\n"));
 	return(1);
 }
@@ -809,16 +856,16 @@ void feh_draw_filename(winwidget w)
 	gib_imlib_get_text_size(fn, FEH_FILE(w->file->data)->filename, NULL, &tw,
 			&th, IMLIB_TEXT_TO_RIGHT);
 
-	if (gib_list_length(filelist) > 1) {
-		len = snprintf(NULL, 0, "%d of %d",  gib_list_length(filelist),
-				gib_list_length(filelist)) + 1;
+	if (feh_filelist_length() > 1) {
+		len = snprintf(NULL, 0, "%d of %d",  feh_filelist_length(),
+				feh_filelist_length()) + 1;
 		s = emalloc(len);
 		if (w->file)
-			snprintf(s, len, "%d of %d", gib_list_num(filelist, w->file) +
-					1, gib_list_length(filelist));
+			snprintf(s, len, "%d of %d", feh_filelist_position(w->file) +
+					1, feh_filelist_length());
 		else
-			snprintf(s, len, "%d of %d", gib_list_num(filelist, current_file) +
-					1, gib_list_length(filelist));
+			snprintf(s, len, "%d of %d", feh_filelist_position(current_file) +
+					1, feh_filelist_length());
 
 		gib_imlib_get_text_size(fn, s, NULL, &nw, NULL, IMLIB_TEXT_TO_RIGHT);
 
@@ -968,6 +1015,7 @@ void feh_draw_info(winwidget w)
 	char info_line[256];
 	char *info_buf[128];
 	FILE *info_pipe;
+	long long trace_begin;
 
 	if ((!w->file) || (!FEH_FILE(w->file->data))
 			|| (!FEH_FILE(w->file->data)->filename))
@@ -977,6 +1025,7 @@ void feh_draw_info(winwidget w)
 
 	info_cmd = feh_printf(opt.info_cmd, FEH_FILE(w->file->data), w);
 
+	trace_begin = feh_trace_begin();
 	info_pipe = popen(info_cmd, "r");
 
 	if (!info_pipe) {
@@ -1003,6 +1052,7 @@ void feh_draw_info(winwidget w)
 		}
 		pclose(info_pipe);
 	}
+	feh_trace_end("info command", info_cmd, trace_begin);
 
 	if (no_lines == 0)
 		return;
@@ -1198,7 +1248,7 @@ void feh_display_status(char stat)
 	}
 
 	if (!init_len)
-		init_len = gib_list_length(filelist);
+		init_len = feh_filelist_length();
 
 	if (i) {
 		if (reset_output) {
@@ -1208,7 +1258,7 @@ void feh_display_status(char stat)
 		}
 
 		if (!(i % 50)) {
-			int len = gib_list_length(filelist);
+			int len = feh_filelist_length();
 
 			fprintf(stderr, " %5d/%d (%d)\n[%3d%%] ",
 					i, init_len, len, ((int) ((float) i / init_len * 100)));
@@ -1234,7 +1284,11 @@ void feh_edit_inplace(winwidget w, int op)
 	if (!w->file || !w->file->data || !FEH_FILE(w->file->data)->filename)
 		return;
 
+	/* flips and square rotations leave the frame cache key unchanged */
+	feh_frame_cache_forget(FEH_FILE(w->file->data));
+
 	if (!opt.edit) {
+		feh_image_cache_invalidate(w->im);
 		imlib_context_set_image(w->im);
 		if (op == INPLACE_EDIT_FLIP)
 			imlib_image_flip_vertical();
@@ -1283,6 +1337,7 @@ void feh_edit_inplace(winwidget w, int op)
 		 * Image was opened using curl/magick or has been deleted after
 		 * opening it
 		 */
+		feh_image_cache_invalidate(w->im);
 		imlib_context_set_image(w->im);
 		if (op == INPLACE_EDIT_FLIP)
 			imlib_image_flip_vertical();
@@ -0,0 +1,290 @@
+/* infocache.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "infocache.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <stdint.h>
+
+/*
+ * Persistent cache of file infos (--info-cache).
+ *
+ * Sorting by image properties, --list and the dimension filters need the
+ * size and format of every image, which means decoding all of them. This
+ * cache remembers them across runs, keyed by device, inode, size and
+ * modification time, so that a file is only decoded again once it has
+ * changed. --auto-rotate is part of the key as well, since it swaps the
+ * dimensions of rotated JPEGs.
+ *
+ * The cache file is a header followed by fixed-size records sorted by key.
+ * It is mapped read-only and searched in place. Infos learned during a run
+ * are collected in memory and merged into a new file, which then replaces
+ * the old one. The file uses native byte order; a cache written by a
+ * different architecture is ignored.
+ */
+
+#define INFO_CACHE_MAGIC 0x49484546	/* "FEHI" in little endian */
+#define INFO_CACHE_VERSION 2
+#define INFO_CACHE_FORMAT_SIZE 24
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t count;
+} info_cache_header;
+
+typedef struct {
+	uint64_t dev;
+	uint64_t ino;
+	int64_t size;
+	int64_t mtime_ns;
+	int32_t width;
+	int32_t height;
+	uint8_t has_alpha;
+	uint8_t auto_rotate;
+	char format[INFO_CACHE_FORMAT_SIZE];
+	uint8_t probed;
+	uint8_t reserved[5];
+} info_cache_record;
+
+static int mapped = 0;
+static void *map = NULL;
+static size_t map_size = 0;
+static info_cache_record *records = NULL;
+static size_t record_count = 0;
+
+/* learned during this run, unsorted */
+static info_cache_record *added = NULL;
+static size_t added_count = 0;
+static size_t added_size = 0;
+
+static void feh_info_cache_key(info_cache_record *rec, struct stat *st)
+{
+	memset(rec, 0, sizeof(info_cache_record));
+	rec->dev = st->st_dev;
+	rec->ino = st->st_ino;
+	rec->size = st->st_size;
+	rec->mtime_ns = (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#ifdef HAVE_LIBEXIF
+	rec->auto_rotate = opt.auto_rotate ? 1 : 0;
+#endif
+	return;
+}
+
+static int feh_info_cache_cmp(const void *a, const void *b)
+{
+	const info_cache_record *r1 = a, *r2 = b;
+
+	if (r1->dev != r2->dev)
+		return((r1->dev < r2->dev) ? -1 : 1);
+	if (r1->ino != r2->ino)
+		return((r1->ino < r2->ino) ? -1 : 1);
+	if (r1->size != r2->size)
+		return((r1->size < r2->size) ? -1 : 1);
+	if (r1->mtime_ns != r2->mtime_ns)
+		return((r1->mtime_ns < r2->mtime_ns) ? -1 : 1);
+	return(r1->auto_rotate - r2->auto_rotate);
+}
+
+static void feh_info_cache_map(void)
+{
+	info_cache_header *header;
+	struct stat st;
+	int fd;
+
+	mapped = 1;
+
+	if ((fd = open(opt.info_cache_file, O_RDONLY | O_CLOEXEC)) < 0)
+		return;
+
+	if (fstat(fd, &st) || (st.st_size < (off_t) sizeof(info_cache_header))) {
+		close(fd);
+		return;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		map = NULL;
+		return;
+	}
+	map_size = st.st_size;
+
+	header = map;
+	if ((header->magic != INFO_CACHE_MAGIC) || (header->version != INFO_CACHE_VERSION)
+			|| (header->count > (map_size - sizeof(info_cache_header))
+				/ sizeof(info_cache_record))) {
+		weprintf("--info-cache: ignoring %s, it was written by an incompatible "
+				"version of feh", opt.info_cache_file);
+		return;
+	}
+
+	records = (info_cache_record *) ((char *) map + sizeof(info_cache_header));
+	record_count = header->count;
+	return;
+}
+
+/*
+ * Map the cache file right away instead of on first use. Afterwards,
+ * feh_info_cache_get may be called from several threads at once.
+ */
+void feh_info_cache_open(void)
+{
+	if (opt.info_cache_file && !mapped)
+		feh_info_cache_map();
+	return;
+}
+
+/*
+ * Fill in file->info from the cache if the file described by st is known.
+ * Returns 1 on a hit.
+ */
+int feh_info_cache_get(struct stat *st, feh_file * file)
+{
+	info_cache_record key, *rec;
+	char format[INFO_CACHE_FORMAT_SIZE + 1];
+
+	if (!opt.info_cache_file)
+		return(0);
+	if (!mapped)
+		feh_info_cache_map();
+	if (!record_count)
+		return(0);
+
+	feh_info_cache_key(&key, st);
+	if (!(rec = bsearch(&key, records, record_count, sizeof(info_cache_record),
+					feh_info_cache_cmp)))
+		return(0);
+
+	file->info = feh_file_info_new();
+	file->info->width = rec->width;
+	file->info->height = rec->height;
+	file->info->has_alpha = rec->has_alpha;
+	file->info->probed = rec->probed;
+	file->info->pixels = rec->width * rec->height;
+	memcpy(format, rec->format, INFO_CACHE_FORMAT_SIZE);
+	format[INFO_CACHE_FORMAT_SIZE] = '\0';
+	file->info->format = estrdup(format);
+	file->info->size = st->st_size;
+	file->info->mtime_ns = st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+	return(1);
+}
+
+/* Remember info for the file described by st */
+void feh_info_cache_put(struct stat *st, feh_file_info * info)
+{
+	info_cache_record *rec;
+
+	if (!opt.info_cache_file)
+		return;
+
+	if (added_count == added_size) {
+		added_size = added_size ? added_size * 2 : 256;
+		added = erealloc(added, added_size * sizeof(info_cache_record));
+	}
+	rec = &added[added_count++];
+	feh_info_cache_key(rec, st);
+	rec->width = info->width;
+	rec->height = info->height;
+	rec->has_alpha = info->has_alpha;
+	rec->probed = info->probed;
+	strncpy(rec->format, info->format ? info->format : "", INFO_CACHE_FORMAT_SIZE);
+	return;
+}
+
+/* Merge the infos learned so far into the cache file */
+void feh_info_cache_save(void)
+{
+	info_cache_header header;
+	size_t i = 0, j = 0, n;
+	char *tmpname;
+	FILE *fp;
+	int cmp, ok;
+
+	if (!opt.info_cache_file || !added_count)
+		return;
+
+	qsort(added, added_count, sizeof(info_cache_record), feh_info_cache_cmp);
+
+	tmpname = estrjoin("", opt.info_cache_file, ".tmp", NULL);
+	if (!(fp = fopen(tmpname, "w"))) {
+		weprintf("--info-cache: cannot write %s:", tmpname);
+		free(tmpname);
+		return;
+	}
+
+	header.magic = INFO_CACHE_MAGIC;
+	header.version = INFO_CACHE_VERSION;
+	header.count = 0;
+	ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+
+	/* both are sorted; on equal keys, the newer record wins */
+	while (ok && ((i < record_count) || (j < added_count))) {
+		if (i == record_count)
+			cmp = 1;
+		else if (j == added_count)
+			cmp = -1;
+		else
+			cmp = feh_info_cache_cmp(&records[i], &added[j]);
+
+		if (cmp < 0)
+			ok = (fwrite(&records[i++], sizeof(info_cache_record), 1, fp) == 1);
+		else {
+			for (n = j + 1; (n < added_count)
+					&& !feh_info_cache_cmp(&added[j], &added[n]); n++)
+				;
+			ok = (fwrite(&added[n - 1], sizeof(info_cache_record), 1, fp) == 1);
+			j = n;
+			if (cmp == 0)
+				i++;
+		}
+		header.count++;
+	}
+
+	if (ok) {
+		rewind(fp);
+		ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+	}
+	if ((fclose(fp) != 0) || !ok || (rename(tmpname, opt.info_cache_file) != 0)) {
+		weprintf("--info-cache: cannot write %s:", opt.info_cache_file);
+		unlink(tmpname);
+		free(tmpname);
+		return;
+	}
+	free(tmpname);
+
+	/* start over from the new file, so a later save does not lose anything */
+	if (map)
+		munmap(map, map_size);
+	map = NULL;
+	records = NULL;
+	record_count = 0;
+	mapped = 0;
+	added_count = 0;
+	return;
+}
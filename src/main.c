@@ -32,7 +32,14 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "events.h"
 #include "signals.h"
 #include "wallpaper.h"
+#include "sync.h"
+#include "prefetch.h"
+#include "imagecache.h"
+#include "metrics.h"
+#include "trace.h"
+#include "infocache.h"
 #include <termios.h>
+#include <poll.h>
 
 char **cmdargv = NULL;
 int cmdargc = 0;
@@ -46,6 +53,7 @@ int main(int argc, char **argv)
 
 	setup_signal_handlers();
 	init_parse_options(argc, argv);
+	feh_trace_init();
 
 	init_imlib_fonts();
 
@@ -56,11 +64,15 @@ int main(int argc, char **argv)
 	}
 
 	feh_event_init();
+	feh_metrics_init();
 
+	/*
+	 * Decoded slides are cached by feh itself (see imagecache.c), which is
+	 * what --cache-size controls. Imlib2's own cache only sees images which
+	 * are freed elsewhere, so a small one is enough.
+	 */
 	imlib_set_cache_size(2048 * 1024);
-	//imlib_set_cache_size(51200 * 1024);
 
-	
 	if (opt.index)
 		init_index_mode();
 	else if (opt.multiwindow)
@@ -92,24 +104,55 @@ int main(int argc, char **argv)
 	return(sig_exit);
 }
 
+/*
+ * Round seconds up to a poll() timeout in milliseconds. Long delays are
+ * clamped, leaving room for the slide timer's extra millisecond; waking up
+ * early is harmless.
+ */
+static int feh_poll_timeout(double seconds)
+{
+	double ms = ceil(seconds * 1000.0);
+
+	return((ms >= (double) (INT_MAX - 1)) ? INT_MAX - 1 : (int) ms);
+}
+
 /* Return 0 to stop iterating, 1 if ok to continue. */
 int feh_main_iteration()
 {
 	static int first = 1;
 	static int xfd = 0;
-	//static int fdsize = 0;
-	XEvent ev;
-	fd_set fdset;
-	static int currentIndex = -1;
 	static int prevIndex = -1;
+	static long long prevSlot = 0;
+	static int prevCount = 0;
+	static int slide_fd = -1;
+	static int sync_fd = -1;
+	int prefetch_fd;
+	int currentIndex;
+	long long slot;
+	int synced = 0;
+	int timeout = -1;
+	int count;
+	int slide_idx = -1, sync_idx = -1, stdin_idx = -1, prefetch_idx = -1;
+	double t1;
+	long long trace_begin;
+	nfds_t nfds = 1;
+	struct pollfd pfds[5];
+	XEvent ev;
 
 	if (window_num == 0 || sig_exit != 0)
 		return(0);
 
+	/*
+	 * The time-synchronized slideshow only makes sense once there is a
+	 * slideshow window and a usable interval. Other modes (index,
+	 * thumbnail, multiwindow) never switch slides on their own.
+	 */
+	if (opt.slideshow && opt.w_data && (opt.interval > 0.0) && (opt.pic_count > 0))
+		synced = 1;
+
 	if (first) {
 		/* Only need to set these up the first time */
 		xfd = ConnectionNumber(disp);
-		//fdsize = xfd + 1;
 		prevIndex = opt.initial_index;
 		first = 0;
 		/*
@@ -125,20 +168,66 @@ int feh_main_iteration()
 		if (isatty(STDIN_FILENO) && !opt.multiwindow && getpgrp() == (tcgetpgrp(STDIN_FILENO))) {
 			setup_stdin();
 		}
+		if (synced) {
+			feh_sync_init();
+			sync_fd = feh_sync_get_fd();
+			slide_fd = feh_slide_timer_arm(opt.interval);
+			prevSlot = feh_get_pic_slot(opt.interval);
+			prevCount = opt.pic_count;
+			slideshow_preroll_index(opt.w_data,
+					feh_pic_slot_to_index(prevSlot + 1, opt.pic_count));
+		}
 	}
 
-	currentIndex = feh_get_pic_index(opt.interval,opt.pic_count);
+	if (synced) {
+		slot = feh_get_pic_slot(opt.interval);
 
-	if (currentIndex != prevIndex) {
-		slideshow_change_image_by_index(opt.w_data, currentIndex);
-	}
+		/*
+		 * A follower which was slightly ahead of its leader may see its
+		 * clock corrected back into the previous slot. Flipping back to the
+		 * previous image for a few milliseconds would be worse than
+		 * waiting for the boundary.
+		 */
+		if (feh_sync_is_follower() && (slot == prevSlot - 1))
+			slot = prevSlot;
+
+		if (slot != prevSlot)
+			feh_sync_slot_changed(slot);
 
-	prevIndex = currentIndex;
+		currentIndex = feh_pic_slot_to_index(slot, opt.pic_count);
+
+		/*
+		 * When files are added to or removed from the playlist in the middle
+		 * of a slot (--stream, --reload), the slot maps to a different
+		 * image. The current one stays until the next boundary.
+		 */
+		if ((opt.pic_count != prevCount) && (slot == prevSlot)) {
+			prevIndex = currentIndex;
+			slideshow_preroll_index(opt.w_data,
+					feh_pic_slot_to_index(slot + 1, opt.pic_count));
+		}
+		prevCount = opt.pic_count;
+
+		if (currentIndex != prevIndex) {
+			trace_begin = feh_trace_begin();
+			slideshow_change_image_by_index(opt.w_data, currentIndex);
+			feh_trace_end("slide change", NULL, trace_begin);
+			feh_sync_slot_shown(slot);
+			slideshow_preroll_index(opt.w_data,
+					feh_pic_slot_to_index(slot + 1, opt.pic_count));
+		}
+
+		prevIndex = currentIndex;
+		prevSlot = slot;
+	}
 
 	while (XPending(disp)) {
 		XNextEvent(disp, &ev);
-		if (ev_handler[ev.type])
+		if (ev_handler[ev.type]) {
+			trace_begin = feh_trace_begin();
 			(*(ev_handler[ev.type])) (&ev);
+			feh_trace_end(feh_trace_event_name(ev.type), NULL, trace_begin);
+		}
 
 		if (window_num == 0 || sig_exit != 0)
 			return(0);
@@ -147,14 +236,82 @@ int feh_main_iteration()
 
 	feh_redraw_menus();
 
-	FD_ZERO(&fdset);
-	FD_SET(xfd, &fdset);
-	if (control_via_stdin)
-		FD_SET(STDIN_FILENO, &fdset);
+	pfds[0].fd = xfd;
+	pfds[0].events = POLLIN;
+	pfds[0].revents = 0;
+	if (synced && (slide_fd >= 0)) {
+		slide_idx = nfds++;
+		pfds[slide_idx].fd = slide_fd;
+		pfds[slide_idx].events = POLLIN;
+		pfds[slide_idx].revents = 0;
+	}
+	if (synced && (sync_fd >= 0)) {
+		sync_idx = nfds++;
+		pfds[sync_idx].fd = sync_fd;
+		pfds[sync_idx].events = POLLIN;
+		pfds[sync_idx].revents = 0;
+	}
+	if ((prefetch_fd = feh_prefetch_get_fd()) >= 0) {
+		prefetch_idx = nfds++;
+		pfds[prefetch_idx].fd = prefetch_fd;
+		pfds[prefetch_idx].events = POLLIN;
+		pfds[prefetch_idx].revents = 0;
+	}
+	if (control_via_stdin) {
+		stdin_idx = nfds++;
+		pfds[stdin_idx].fd = STDIN_FILENO;
+		pfds[stdin_idx].events = POLLIN;
+		pfds[stdin_idx].revents = 0;
+	}
+
+	/*
+	 * Without a slide timer, sleep until the next slide boundary. Round up
+	 * to the next millisecond so that we never wake up just before the
+	 * boundary and spin until it has actually passed. With a slide timer,
+	 * the timeout is only a safety net in case the timer fires slightly
+	 * early (e.g. with a non-realtime --sync-clock).
+	 */
+	if (synced) {
+		timeout = feh_poll_timeout(feh_get_time_to_next_pic(opt.interval));
+		if (slide_fd >= 0)
+			timeout++;
+	}
+
+	/* --slideshow-delay is held while zooming/panning/etc or paused, see timers.c */
+	if ((t1 = feh_get_timer_timeout()) >= 0.0) {
+		D(("I next need to action a timer in %f seconds\n", t1));
+		if ((timeout < 0) || (feh_poll_timeout(t1) < timeout))
+			timeout = feh_poll_timeout(t1);
+	}
+
+	/* Don't block if there are events in the queue. That's a bit rude ;-) */
+	if (XPending(disp) == 0) {
+		errno = 0;
+		D(("Performing blocking poll - timeout %d ms\n", timeout));
+		count = poll(pfds, nfds, timeout);
+		if ((count < 0) && (errno != EINTR))
+			eprintf("Connection to X display lost");
+		else if (count > 0) {
+			/* The slide itself is changed at the start of the next iteration */
+			if ((slide_idx >= 0) && (pfds[slide_idx].revents & POLLIN))
+				feh_slide_timer_ack(opt.interval);
+			/* Boundaries move when we adjust to the leader's clock */
+			if ((sync_idx >= 0) && (pfds[sync_idx].revents & POLLIN)
+					&& feh_sync_receive() && (slide_fd >= 0))
+				feh_slide_timer_arm(opt.interval);
+			if ((prefetch_idx >= 0) && (pfds[prefetch_idx].revents & POLLIN))
+				feh_prefetch_handle();
+			if ((stdin_idx >= 0)
+					&& (pfds[stdin_idx].revents & (POLLIN | POLLHUP | POLLERR)))
+				feh_event_handle_stdin();
+		}
+	}
+
+	feh_handle_timer();
 
 	if (window_num == 0 || sig_exit != 0)
 		return(0);
-	
+
 	return(1);
 }
 
@@ -162,6 +319,13 @@ void feh_clean_exit(void)
 {
 	delete_rm_files();
 
+	if (opt.verbose)
+		feh_image_cache_print_stats();
+
+	feh_metrics_save();
+	feh_info_cache_save();
+	feh_trace_flush();
+
 	free(opt.menu_font);
 
 	if(disp)
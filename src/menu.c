@@ -1268,37 +1268,43 @@ void feh_menu_cb(feh_menu * m, feh_menu_item * i, int action, unsigned short dat
 			feh_filelist_image_remove(m->fehwin, 1);
 			break;
 		case CB_SORT_FILENAME:
-			filelist = gib_list_sort(filelist, feh_cmp_filename);
+			filelist = feh_filelist_sort(filelist, SORT_FILENAME);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_IMAGENAME:
-			filelist = gib_list_sort(filelist, feh_cmp_name);
+			filelist = feh_filelist_sort(filelist, SORT_NAME);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_DIRNAME:
-			filelist = gib_list_sort(filelist, feh_cmp_dirname);
+			filelist = feh_filelist_sort(filelist, SORT_DIRNAME);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_MTIME:
-			filelist = gib_list_sort(filelist, feh_cmp_mtime);
+			filelist = feh_filelist_sort(filelist, SORT_MTIME);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_FILESIZE:
-			filelist = gib_list_sort(filelist, feh_cmp_size);
+			filelist = feh_filelist_sort(filelist, SORT_SIZE);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
 			break;
 		case CB_SORT_RANDOMIZE:
 			filelist = gib_list_randomize(filelist);
+			feh_filelist_changed();
 			if (opt.jump_on_resort) {
 				slideshow_change_image(m->fehwin, SLIDE_FIRST, 1);
 			}
@@ -1390,7 +1396,7 @@ static feh_menu *feh_menu_func_gen_info(feh_menu * m)
 	if (!file->info)
 	  feh_file_info_load(file, im);
 	if (file->info) {
-		snprintf(buffer, sizeof(buffer), "Size: %dKb", file->info->size / 1024);
+		snprintf(buffer, sizeof(buffer), "Size: %lldKb", file->info->size / 1024);
 		feh_menu_add_entry(mm, buffer, NULL, 0, 0, NULL);
 		snprintf(buffer, sizeof(buffer), "Dimensions: %dx%d", file->info->width, file->info->height);
 		feh_menu_add_entry(mm, buffer, NULL, 0, 0, NULL);
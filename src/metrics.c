@@ -0,0 +1,151 @@
+/* metrics.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "options.h"
+#include "timers.h"
+#include "metrics.h"
+
+/*
+ * Render pipeline metrics.
+ *
+ * Every stage duration is sorted into a fixed histogram with power-of-two
+ * microsecond buckets, so recording costs two clock_gettime calls and a few
+ * additions and is always on. With --stats-file, the histograms are written
+ * to a file in the Prometheus text format (as understood e.g. by the
+ * node_exporter textfile collector) every few seconds and on exit.
+ */
+
+/* bucket i counts durations below 2^i microseconds, the last one the rest */
+#define METRIC_BUCKETS 25
+
+#define METRIC_SAVE_INTERVAL 10.0
+
+typedef struct {
+	unsigned long count;
+	long long sum_ns;
+	long long max_ns;
+	unsigned long buckets[METRIC_BUCKETS];
+} feh_histogram;
+
+static feh_histogram histograms[METRIC_COUNT];
+
+static const char *metric_names[METRIC_COUNT] = {
+	"stat", "decode", "pixels", "orient", "scale", "overlay", "swap", "render"
+};
+
+long long feh_metric_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+void feh_metric_record(enum feh_metric metric, long long start)
+{
+	feh_histogram *h = &histograms[metric];
+	long long ns = feh_metric_now() - start;
+	long long us = ns / 1000;
+	int bucket = 0;
+
+	while ((bucket < METRIC_BUCKETS - 1) && (us >= (1LL << bucket)))
+		bucket++;
+
+	h->count++;
+	h->sum_ns += ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+	h->buckets[bucket]++;
+	return;
+}
+
+void feh_metrics_write(FILE *fp)
+{
+	unsigned long cumulative;
+	int m, b;
+
+	fputs("# HELP feh_stage_seconds Duration of feh render pipeline stages\n"
+			"# TYPE feh_stage_seconds histogram\n", fp);
+	for (m = 0; m < METRIC_COUNT; m++) {
+		cumulative = 0;
+		for (b = 0; b < METRIC_BUCKETS - 1; b++) {
+			cumulative += histograms[m].buckets[b];
+			fprintf(fp, "feh_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %lu\n",
+					metric_names[m], (double) (1LL << b) / 1000000.0, cumulative);
+		}
+		fprintf(fp, "feh_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n",
+				metric_names[m], histograms[m].count);
+		fprintf(fp, "feh_stage_seconds_sum{stage=\"%s\"} %.9f\n",
+				metric_names[m], histograms[m].sum_ns / 1000000000.0);
+		fprintf(fp, "feh_stage_seconds_count{stage=\"%s\"} %lu\n",
+				metric_names[m], histograms[m].count);
+	}
+
+	fputs("# HELP feh_stage_max_seconds Longest duration seen per stage\n"
+			"# TYPE feh_stage_max_seconds gauge\n", fp);
+	for (m = 0; m < METRIC_COUNT; m++)
+		fprintf(fp, "feh_stage_max_seconds{stage=\"%s\"} %.9f\n",
+				metric_names[m], histograms[m].max_ns / 1000000000.0);
+	return;
+}
+
+/* Write the stats file, replacing the old one atomically */
+void feh_metrics_save(void)
+{
+	char *tmpname;
+	FILE *fp;
+
+	if (!opt.stats_file)
+		return;
+
+	tmpname = estrjoin("", opt.stats_file, ".tmp", NULL);
+	if (!(fp = fopen(tmpname, "w"))) {
+		weprintf("--stats-file: cannot write %s:", tmpname);
+		free(tmpname);
+		return;
+	}
+	feh_metrics_write(fp);
+	if ((fclose(fp) != 0) || (rename(tmpname, opt.stats_file) != 0)) {
+		weprintf("--stats-file: cannot write %s:", opt.stats_file);
+		unlink(tmpname);
+	}
+	free(tmpname);
+	return;
+}
+
+static void cb_metrics_timer(void *data __attribute__((unused)))
+{
+	feh_metrics_save();
+	feh_add_timer(cb_metrics_timer, NULL, METRIC_SAVE_INTERVAL);
+	return;
+}
+
+void feh_metrics_init(void)
+{
+	if (opt.stats_file)
+		feh_add_timer(cb_metrics_timer, NULL, METRIC_SAVE_INTERVAL);
+	return;
+}
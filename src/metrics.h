@@ -0,0 +1,48 @@
+/* metrics.h
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+/* Stages of getting a slide onto the screen */
+enum feh_metric {
+	METRIC_STAT,		/* stat() of the image file */
+	METRIC_DECODE,		/* loading and decoding (incl. dcraw / convert) */
+	METRIC_PIXELS,		/* decoding the pixels of a prefetched or pre-rolled slide */
+	METRIC_ORIENT,		/* applying the EXIF orientation */
+	METRIC_SCALE,		/* scaling the image into the window's pixmap */
+	METRIC_OVERLAY,		/* drawing captions, file name, info etc. */
+	METRIC_SWAP,		/* making the new frame visible */
+	METRIC_RENDER,		/* all of winwidget_render_image */
+	METRIC_COUNT
+};
+
+long long feh_metric_now(void);
+void feh_metric_record(enum feh_metric metric, long long start);
+void feh_metrics_write(FILE * fp);
+void feh_metrics_init(void);
+void feh_metrics_save(void);
+
+#endif
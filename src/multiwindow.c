@@ -30,6 +30,26 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "options.h"
 #include "signals.h"
 
+/*
+ * --reload in multiwindow mode: each window reloads its own image. The
+ * slideshow's cb_reload_timer would rebuild the shared filelist instead.
+ */
+static void cb_multiwindow_reload_timer(void *data)
+{
+	winwidget w = (winwidget) data;
+	int i;
+
+	/* the window may have been closed in the meantime */
+	for (i = 0; i < window_num; i++) {
+		if ((windows[i] == w) && (w->type == WIN_TYPE_SINGLE)) {
+			feh_reload_image(w, 0, 0);
+			feh_add_timer(cb_multiwindow_reload_timer, w, opt.reload);
+			break;
+		}
+	}
+	return;
+}
+
 void init_multiwindow_mode(void)
 {
 	winwidget w = NULL;
@@ -44,7 +64,7 @@ void init_multiwindow_mode(void)
 		if ((w = winwidget_create_from_file(l, WIN_TYPE_SINGLE)) != NULL) {
 			winwidget_show(w);
 			if (opt.reload > 0)
-				feh_add_unique_timer(cb_reload_timer, w, opt.reload);
+				feh_add_timer(cb_multiwindow_reload_timer, w, opt.reload);
 			if (!feh_main_iteration(0))
 				exit(0);
 		} else {
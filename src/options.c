@@ -29,6 +29,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "feh.h"
 #include "filelist.h"
 #include "options.h"
+#include "stream.h"
 
 static void check_options(void);
 static void feh_getopt_theme(int argc, char **argv);
@@ -38,6 +39,7 @@ static void feh_parse_options_from_string(char *opts);
 static void feh_load_options_for_theme(char *theme);
 static void show_usage(void);
 static void show_version(void);
+static long long feh_parse_ns(char *str);
 static char *theme;
 
 fehoptions opt;
@@ -69,6 +71,7 @@ void init_parse_options(int argc, char **argv)
 
 	opt.screen_clip = 1;
 	opt.cache_size = 4;
+	opt.sync_clock = CLOCK_REALTIME;
 #ifdef HAVE_LIBXINERAMA
 	/* if we're using xinerama, then enable it by default */
 	opt.xinerama = 1;
@@ -95,16 +98,30 @@ void init_parse_options(int argc, char **argv)
 
 	D(("Options parsed\n"));
 
+	feh_stream_start();
+
 	filelist_len = gib_list_length(filelist);
-	if (!filelist_len)
+	if (!filelist_len && !feh_stream_active())
 		show_mini_usage();
 
 	check_options();
 
 	feh_prepare_filelist();
+
+	/* with --stream, the slideshow can start as soon as there is one file */
+	if (!filelist_len && !feh_stream_wait())
+		show_mini_usage();
 	return;
 }
 
+/* Whether main() will run the slideshow rather than another mode */
+int feh_slideshow_selected(void)
+{
+	return(opt.display && !opt.index && !opt.multiwindow && !opt.list
+			&& !opt.customlist && !opt.loadables && !opt.unloadables
+			&& !opt.thumbs && !opt.bgmode);
+}
+
 static void feh_check_theme_options(char **argv)
 {
 	if (!theme) {
@@ -425,6 +442,19 @@ static void feh_parse_option_array(int argc, char **argv, int finalrun)
 		{"conversion-timeout" , 1, 0, 245},
 		{"version-sort"  , 0, 0, 246},
 		{"offset"        , 1, 0, 247},
+		{"sync-clock"    , 1, 0, 248},
+		{"sync-epoch"    , 1, 0, 249},
+		{"sync-phase"    , 1, 0, 250},
+		{"sync-leader"   , 1, 0, 251},
+		{"sync-follow"   , 1, 0, 252},
+		{"prefetch"      , 1, 0, 253},
+		{"frame-cache"   , 1, 0, 254},
+		{"stats-file"    , 1, 0, 255},
+		{"trace"         , 1, 0, 256},
+		{"info-cache"    , 1, 0, 257},
+		{"filelist-format", 1, 0, 258},
+		{"stream"        , 0, 0, 259},
+		{"sync-seed"     , 1, 0, 260},
 		{0, 0, 0, 0}
 	};
 	int optch = 0, cmdx = 0;
@@ -809,6 +839,70 @@ static void feh_parse_option_array(int argc, char **argv, int finalrun)
 			opt.offset_flags = XParseGeometry(optarg, &opt.offset_x,
 					&opt.offset_y, (unsigned int *)&discard, (unsigned int *)&discard);
 			break;
+		case 248:
+			if (!strcmp(optarg, "realtime")) {
+				opt.sync_clock = CLOCK_REALTIME;
+#ifdef CLOCK_TAI
+			} else if (!strcmp(optarg, "tai")) {
+				opt.sync_clock = CLOCK_TAI;
+#endif
+			} else {
+				weprintf("Unrecognized sync clock \"%s\". "
+						"Supported clocks: realtime"
+#ifdef CLOCK_TAI
+						", tai"
+#endif
+						"\n", optarg);
+			}
+			break;
+		case 249:
+			opt.sync_epoch_ns = feh_parse_ns(optarg);
+			break;
+		case 250:
+			opt.sync_phase = atof(optarg);
+			break;
+		case 251:
+			opt.sync_leader = estrdup(optarg);
+			break;
+		case 252:
+			opt.sync_follow = estrdup(optarg);
+			break;
+		case 253:
+			opt.prefetch_ahead = atoi(optarg);
+			if (strchr(optarg, ','))
+				opt.prefetch_behind = atoi(strchr(optarg, ',') + 1);
+			if ((opt.prefetch_ahead < 0) || (opt.prefetch_behind < 0))
+				eprintf("--prefetch: slide counts must not be negative");
+			break;
+		case 254:
+			opt.frame_cache = atoi(optarg);
+			if (opt.frame_cache < 0)
+				opt.frame_cache = 0;
+			break;
+		case 255:
+			opt.stats_file = estrdup(optarg);
+			break;
+		case 256:
+			opt.trace_file = estrdup(optarg);
+			break;
+		case 257:
+			opt.info_cache_file = estrdup(optarg);
+			break;
+		case 258:
+			if (!strcmp(optarg, "text"))
+				opt.filelist_format = FILELIST_FORMAT_TEXT;
+			else if (!strcmp(optarg, "binary"))
+				opt.filelist_format = FILELIST_FORMAT_BINARY;
+			else
+				weprintf("Unrecognized filelist format \"%s\". "
+						"Supported formats: text, binary\n", optarg);
+			break;
+		case 259:
+			opt.stream = 1;
+			break;
+		case 260:
+			opt.sync_seed = strtoull(optarg, NULL, 0);
+			break;
 		default:
 			break;
 		}
@@ -816,13 +910,18 @@ static void feh_parse_option_array(int argc, char **argv, int finalrun)
 
 	/* Now the leftovers, which must be files */
 	if (optind < argc) {
+		int stream = finalrun && feh_stream_possible(argc - optind, argv + optind);
+
 		while (optind < argc) {
 			if (opt.reload)
 				original_file_items = gib_list_add_front(original_file_items, estrdup(argv[optind]));
 			/* If recursive is NOT set, but the only argument is a directory
 			   name, we grab all the files in there, but not subdirs */
 			//printf("one thing\n");
-			add_file_to_filelist_recursively(argv[optind++], FILELIST_FIRST);
+			if (stream)
+				feh_stream_add_item(argv[optind++]);
+			else
+				add_file_to_filelist_recursively(argv[optind++], FILELIST_FIRST);
 		}
 	}
 	else if (finalrun && !opt.filelistfile && !opt.bgmode) {
@@ -837,7 +936,10 @@ static void feh_parse_option_array(int argc, char **argv, int finalrun)
 			free(target_directory);
 		} else {
 			//printf("three thing\n");
-			add_file_to_filelist_recursively(".", FILELIST_FIRST);
+			if (feh_stream_possible(0, NULL))
+				feh_stream_add_item(".");
+			else
+				add_file_to_filelist_recursively(".", FILELIST_FIRST);
 		}
 	}
 
@@ -846,6 +948,37 @@ static void feh_parse_option_array(int argc, char **argv, int finalrun)
 	return;
 }
 
+/*
+ * Parse a (possibly negative) decimal number of seconds into nanoseconds
+ * without going through a double, which cannot hold current Unix
+ * timestamps with nanosecond precision.
+ */
+static long long feh_parse_ns(char *str)
+{
+	long long ns = 0;
+	long long scale = 100000000LL;
+	int negative = 0;
+	char *c = str;
+
+	while (isspace((unsigned char) *c))
+		c++;
+	if ((*c == '-') || (*c == '+'))
+		negative = (*c++ == '-');
+
+	for (; isdigit((unsigned char) *c); c++)
+		ns = ns * 10 + (*c - '0');
+	ns *= 1000000000LL;
+
+	if (*c == '.')
+		for (c++; isdigit((unsigned char) *c); c++, scale /= 10)
+			ns += (*c - '0') * scale;
+
+	if (*c != '\0')
+		weprintf("Ignoring trailing garbage in number \"%s\"", str);
+
+	return(negative ? -ns : ns);
+}
+
 static void check_options(void)
 {
 	int i;
@@ -879,6 +1012,10 @@ static void check_options(void)
 		eprintf("You cannot combine --loadable with --unloadable");
 	}
 
+	if (opt.sync_leader && opt.sync_follow) {
+		eprintf("You cannot combine --sync-leader with --sync-follow");
+	}
+
 	return;
 }
 
@@ -907,6 +1044,10 @@ static void show_version(void)
 		"stat64 "
 #endif
 
+#ifdef HAVE_TIMERFD
+		"timerfd "
+#endif
+
 #ifdef HAVE_VERSCMP
 		"verscmp "
 #endif
@@ -33,6 +33,12 @@ enum on_last_slide_action {
 	ON_LAST_SLIDE_HOLD
 };
 
+enum filelist_format {
+	FILELIST_FORMAT_KEEP = 0,
+	FILELIST_FORMAT_TEXT,
+	FILELIST_FORMAT_BINARY
+};
+
 struct __fehoptions {
 	unsigned char multiwindow;
 	unsigned char montage;
@@ -129,11 +135,43 @@ struct __fehoptions {
         double interval;
         int initial_index;
         void *w_data;
+
+	/* clock, epoch and phase (in slots) of the time-synchronized slideshow */
+	clockid_t sync_clock;
+	long long sync_epoch_ns;
+	double sync_phase;
+	char *sync_leader;
+	char *sync_follow;
+
+	/* key of the slot permutation used by --randomize in a timed slideshow */
+	unsigned long long sync_seed;
+
+	/* slides after and before the current one which are kept decoded */
+	int prefetch_ahead;
+	int prefetch_behind;
+
+	/* where to write render pipeline metrics */
+	char *stats_file;
+
+	/* where to write a timeline of slide changes and event handling */
+	char *trace_file;
+
+	/* where to remember image dimensions and formats across runs */
+	char *info_cache_file;
+
+	/* format for writing filelists, see enum filelist_format */
+	unsigned char filelist_format;
+
+	/* start the slideshow while the directories are still being scanned */
+	unsigned char stream;
+
 	/* signed in case someone wants to invert scrolling real quick */
 	int scroll_step;
 
-	// imlib cache size in mebibytes
+	// decoded image cache size in mebibytes
 	int cache_size;
+	/* number of rendered full screen frames kept as pixmaps */
+	int frame_cache;
 
 	unsigned int min_width, min_height, max_width, max_height;
 
@@ -232,6 +270,7 @@ enum key_action {
 };
 
 void init_parse_options(int argc, char **argv);
+int feh_slideshow_selected(void);
 char *feh_string_normalize(char *str);
 
 extern fehoptions opt;
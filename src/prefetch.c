@@ -0,0 +1,520 @@
+/* prefetch.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "prefetch.h"
+#include "imagecache.h"
+#include "metrics.h"
+#include "trace.h"
+#include "timers.h"
+#include <fcntl.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+/*
+ * Keeps the images around the current slide decoded, so that stepping
+ * through a slideshow does not stall on the next load.
+ *
+ * Imlib2 keeps its context, image cache and loaders in global state and
+ * must only be used from the main thread. The worker threads therefore
+ * only take care of the part which needs no Imlib2: pulling the file into
+ * the page cache, which is what usually dominates on spinning disks and
+ * network filesystems. Whenever a worker is done it signals an eventfd
+ * (a pipe on other systems) which the main loop polls; the main thread
+ * then decodes one image per wakeup, so X events are still handled in
+ * between.
+ */
+
+#define PREFETCH_THREADS 2
+#define PREFETCH_READ_SIZE (128 * 1024)
+
+enum prefetch_state {
+	PREFETCH_EMPTY, PREFETCH_READING, PREFETCH_READ, PREFETCH_DECODED
+};
+
+typedef struct {
+	gib_list *file;
+	Imlib_Image im;
+	enum prefetch_state state;
+	/* bumped whenever the entry is reused, so stale jobs are ignored */
+	unsigned int serial;
+	/* distance from the current slide, for decoding order */
+	int distance;
+} prefetch_entry;
+
+typedef struct {
+	int entry;
+	unsigned int serial;
+	char *path;
+} prefetch_job;
+
+static prefetch_entry *entries = NULL;
+static int entry_count = 0;
+
+/* jobs for the workers and their results, both guarded by queue_lock */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static prefetch_job *jobs = NULL;
+static int job_head = 0, job_count = 0;
+static prefetch_job *done = NULL;
+static int done_count = 0;
+
+/* the slide the ring was last arranged around */
+static gib_list *ring_current = NULL;
+/* the slide pre-rolled by the window, which the ring must not fetch again */
+static gib_list *ring_held = NULL;
+
+static int wake_fd[2] = { -1, -1 };
+static int initialized = 0;
+
+/* how long the last decode took, and whether one is put off until a slide change */
+static long long decode_ns = 0;
+static int decode_deferred = 0;
+
+static void feh_prefetch_wake(void)
+{
+#ifdef __linux__
+	uint64_t one = 1;
+	ssize_t ret = write(wake_fd[1], &one, sizeof(one));
+#else
+	ssize_t ret = write(wake_fd[1], "", 1);
+#endif
+
+	/* a full pipe or counter already means a pending wakeup */
+	(void) ret;
+	return;
+}
+
+static void *feh_prefetch_worker(void *unused __attribute__((unused)))
+{
+	prefetch_job job;
+	char *buf = emalloc(PREFETCH_READ_SIZE);
+	long long trace_begin;
+	int fd;
+
+	for (;;) {
+		pthread_mutex_lock(&queue_lock);
+		while (job_count == 0)
+			pthread_cond_wait(&queue_cond, &queue_lock);
+		job = jobs[job_head];
+		job_head = (job_head + 1) % entry_count;
+		job_count--;
+		pthread_mutex_unlock(&queue_lock);
+
+		trace_begin = feh_trace_begin();
+		if (job.path && ((fd = open(job.path, O_RDONLY | O_CLOEXEC)) >= 0)) {
+			posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+			while (read(fd, buf, PREFETCH_READ_SIZE) > 0)
+				;
+			close(fd);
+		}
+		feh_trace_end("readahead", job.path, trace_begin);
+		free(job.path);
+
+		pthread_mutex_lock(&queue_lock);
+		done[done_count].entry = job.entry;
+		done[done_count].serial = job.serial;
+		done_count++;
+		pthread_mutex_unlock(&queue_lock);
+
+		feh_prefetch_wake();
+	}
+	return(NULL);
+}
+
+static int feh_prefetch_init(void)
+{
+	pthread_t thread;
+	int i;
+
+	if (initialized)
+		return(initialized > 0);
+
+	initialized = -1;
+
+	if ((opt.prefetch_ahead <= 0) && (opt.prefetch_behind <= 0))
+		return(0);
+
+#ifdef __linux__
+	if ((wake_fd[0] = wake_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		weprintf("prefetch: eventfd failed:");
+		return(0);
+	}
+#else
+	if (pipe(wake_fd) < 0) {
+		weprintf("prefetch: pipe failed:");
+		return(0);
+	}
+	fcntl(wake_fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake_fd[1], F_SETFL, O_NONBLOCK);
+	fcntl(wake_fd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(wake_fd[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+	/* one spare entry for the image handed back by feh_prefetch_give */
+	entry_count = opt.prefetch_ahead + opt.prefetch_behind + 1;
+	entries = emalloc(entry_count * sizeof(prefetch_entry));
+	memset(entries, 0, entry_count * sizeof(prefetch_entry));
+	jobs = emalloc(entry_count * sizeof(prefetch_job));
+	done = emalloc(entry_count * sizeof(prefetch_job));
+
+	for (i = 0; i < PREFETCH_THREADS; i++) {
+		if (pthread_create(&thread, NULL, feh_prefetch_worker, NULL) != 0) {
+			if (i == 0) {
+				weprintf("prefetch: cannot create worker thread");
+				return(0);
+			}
+			break;
+		}
+		pthread_detach(thread);
+	}
+
+	initialized = 1;
+	return(1);
+}
+
+int feh_prefetch_get_fd(void)
+{
+	return((initialized > 0) ? wake_fd[0] : -1);
+}
+
+static void feh_prefetch_drop(prefetch_entry *e)
+{
+	if (e->im)
+		feh_image_cache_put(e->im);
+	e->im = NULL;
+	e->file = NULL;
+	e->state = PREFETCH_EMPTY;
+	e->serial++;
+	return;
+}
+
+static prefetch_entry *feh_prefetch_find(gib_list *file)
+{
+	int i;
+
+	for (i = 0; i < entry_count; i++)
+		if ((entries[i].state != PREFETCH_EMPTY) && (entries[i].file == file))
+			return(&entries[i]);
+	return(NULL);
+}
+
+/* Returns the slide distance slides after (or before, if negative) l */
+static gib_list *feh_prefetch_neighbour(gib_list *l, int distance)
+{
+	for (; l && (distance > 0); distance--)
+		l = l->next ? l->next : filelist;
+	for (; l && (distance < 0); distance++)
+		l = l->prev ? l->prev : feh_filelist_nth(feh_filelist_length() - 1);
+	return(l);
+}
+
+static void feh_prefetch_want(gib_list *file, int distance)
+{
+	prefetch_entry *e;
+	char *path;
+	int i;
+
+	if (file == ring_held)
+		return;
+	if ((e = feh_prefetch_find(file)) != NULL) {
+		e->distance = distance;
+		return;
+	}
+
+	for (i = 0; i < entry_count; i++)
+		if (entries[i].state == PREFETCH_EMPTY)
+			break;
+	if (i == entry_count)
+		return;
+
+	e = &entries[i];
+	e->file = file;
+	e->distance = distance;
+	e->state = PREFETCH_READING;
+
+	/* remote files are fetched by feh_load_image, there is nothing to read */
+	path = FEH_FILE(file->data)->filename;
+	path = path_is_url(path) ? NULL : estrdup(path);
+
+	pthread_mutex_lock(&queue_lock);
+	jobs[(job_head + job_count) % entry_count].entry = i;
+	jobs[(job_head + job_count) % entry_count].serial = e->serial;
+	jobs[(job_head + job_count) % entry_count].path = path;
+	job_count++;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&queue_lock);
+	return;
+}
+
+void feh_prefetch_update(gib_list *current)
+{
+	gib_list *l;
+	int i, keep;
+
+	if (!current || !feh_prefetch_init())
+		return;
+
+	ring_current = current;
+	/* a held slide which is now shown is the slideshow's business */
+	if (ring_held == current)
+		ring_held = NULL;
+
+	/* forget everything which is no longer next to current */
+	for (i = 0; i < entry_count; i++) {
+		if (entries[i].state == PREFETCH_EMPTY)
+			continue;
+		for (keep = -opt.prefetch_behind; keep <= opt.prefetch_ahead; keep++)
+			if (keep && (feh_prefetch_neighbour(current, keep) == entries[i].file)
+					&& (entries[i].file != current))
+				break;
+		if (keep <= opt.prefetch_ahead)
+			continue;
+		/*
+		 * Entries which are still being read stay allocated until their
+		 * job has finished, otherwise the job array could overflow.
+		 */
+		if (entries[i].state == PREFETCH_READING)
+			entries[i].file = NULL;
+		else
+			feh_prefetch_drop(&entries[i]);
+	}
+
+	/* nearest first, and forwards before backwards */
+	for (i = 1; (i <= opt.prefetch_ahead) || (i <= opt.prefetch_behind); i++) {
+		if ((i <= opt.prefetch_ahead)
+				&& ((l = feh_prefetch_neighbour(current, i)) != current))
+			feh_prefetch_want(l, i);
+		if ((i <= opt.prefetch_behind)
+				&& ((l = feh_prefetch_neighbour(current, -i)) != current))
+			feh_prefetch_want(l, i);
+	}
+	return;
+}
+
+static void cb_prefetch_deferred(void *data __attribute__((unused)))
+{
+	decode_deferred = 0;
+	feh_prefetch_wake();
+	return;
+}
+
+/*
+ * Decoding blocks the main loop. In a timed slideshow, a decode which
+ * would probably still run at the next slide change is put off until just
+ * after it, unless no slot is long enough for it anyway.
+ */
+static int feh_prefetch_defer(void)
+{
+	double left;
+
+	if (!opt.slideshow || (opt.interval <= 0.0)
+			|| (decode_ns >= feh_interval_ns(opt.interval)))
+		return(0);
+
+	left = feh_get_time_to_next_pic(opt.interval);
+	if (left * 1000000000.0 >= decode_ns)
+		return(0);
+
+	if (!decode_deferred) {
+		decode_deferred = 1;
+		feh_add_timer(cb_prefetch_deferred, NULL, left);
+	}
+	return(1);
+}
+
+void feh_prefetch_handle(void)
+{
+	prefetch_entry *e, *next = NULL;
+	char buf[8];
+	int i, freed = 0;
+	long long start, load_start;
+
+	while (read(wake_fd[0], buf, sizeof(buf)) > 0)
+		;
+
+	pthread_mutex_lock(&queue_lock);
+	for (i = 0; i < done_count; i++) {
+		e = &entries[done[i].entry];
+		if (e->serial != done[i].serial)
+			continue;
+		if (e->state != PREFETCH_READING)
+			continue;
+		e->state = PREFETCH_READ;
+		/* the slide was dropped while its file was being read */
+		if (!e->file) {
+			feh_prefetch_drop(e);
+			freed = 1;
+		}
+	}
+	done_count = 0;
+	pthread_mutex_unlock(&queue_lock);
+
+	/* freed entries may be needed for slides which did not fit before */
+	if (freed)
+		feh_prefetch_update(ring_current);
+
+	for (i = 0; i < entry_count; i++) {
+		e = &entries[i];
+		if ((e->state == PREFETCH_READ) && (!next || (e->distance < next->distance)))
+			next = e;
+	}
+	if (!next || feh_prefetch_defer())
+		return;
+
+	D(("decoding %s\n", FEH_FILE(next->file->data)->filename));
+	load_start = feh_metric_now();
+	if (feh_load_image_quiet(&next->im, FEH_FILE(next->file->data))) {
+		start = feh_metric_now();
+		gib_imlib_image_decode(next->im);
+		feh_metric_record(METRIC_PIXELS, start);
+		next->state = PREFETCH_DECODED;
+	} else {
+		/* leave it to the slideshow to complain about broken files */
+		next->im = NULL;
+		feh_prefetch_drop(next);
+	}
+	decode_ns = feh_metric_now() - load_start;
+
+	/* one image per wakeup; come back for the rest */
+	for (i = 0; i < entry_count; i++)
+		if (entries[i].state == PREFETCH_READ) {
+			feh_prefetch_wake();
+			break;
+		}
+	return;
+}
+
+Imlib_Image feh_prefetch_take(gib_list *file)
+{
+	prefetch_entry *e;
+	Imlib_Image im;
+
+	if ((initialized <= 0) || !(e = feh_prefetch_find(file))
+			|| (e->state != PREFETCH_DECODED))
+		return(NULL);
+
+	D(("prefetch hit for %s\n", FEH_FILE(file->data)->filename));
+	im = e->im;
+	e->im = NULL;
+	feh_prefetch_drop(e);
+	return(im);
+}
+
+/*
+ * Like feh_prefetch_take, but also keeps the ring from fetching file again
+ * until it is handed back with feh_prefetch_give or becomes the current
+ * slide. An entry which is not decoded yet is dropped, so the caller has to
+ * load the image itself if NULL is returned.
+ */
+Imlib_Image feh_prefetch_hold(gib_list *file)
+{
+	prefetch_entry *e;
+	Imlib_Image im;
+
+	if ((initialized <= 0) || !file)
+		return(NULL);
+
+	ring_held = file;
+	if ((im = feh_prefetch_take(file)) != NULL)
+		return(im);
+
+	if ((e = feh_prefetch_find(file)) != NULL) {
+		if (e->state == PREFETCH_READING)
+			e->file = NULL;
+		else
+			feh_prefetch_drop(e);
+	}
+	return(NULL);
+}
+
+void feh_prefetch_give(gib_list *file, Imlib_Image im)
+{
+	prefetch_entry *e;
+	int i;
+
+	if (file && (file == ring_held))
+		ring_held = NULL;
+
+	/* im may not be file's image, e.g. after --min-dimension rejected it */
+	if ((initialized <= 0) || !file || !im || feh_prefetch_find(file)
+			|| !feh_image_cache_is_from(im, FEH_FILE(file->data))) {
+		feh_image_cache_put(im);
+		return;
+	}
+
+	for (i = 0; i < entry_count; i++)
+		if (entries[i].state == PREFETCH_EMPTY)
+			break;
+	if (i == entry_count) {
+		feh_image_cache_put(im);
+		return;
+	}
+
+	e = &entries[i];
+	e->file = file;
+	e->im = im;
+	e->distance = 1;
+	e->state = PREFETCH_DECODED;
+	return;
+}
+
+void feh_prefetch_forget(gib_list *file)
+{
+	prefetch_entry *e;
+
+	if (ring_current == file)
+		ring_current = NULL;
+	if (ring_held == file)
+		ring_held = NULL;
+
+	if ((initialized > 0) && ((e = feh_prefetch_find(file)) != NULL)) {
+		if (e->state == PREFETCH_READING)
+			e->file = NULL;
+		else
+			feh_prefetch_drop(e);
+	}
+	return;
+}
+
+void feh_prefetch_clear(void)
+{
+	int i;
+
+	ring_current = NULL;
+	ring_held = NULL;
+
+	for (i = 0; (initialized > 0) && (i < entry_count); i++) {
+		if (entries[i].state == PREFETCH_READING)
+			entries[i].file = NULL;
+		else if (entries[i].state != PREFETCH_EMPTY)
+			feh_prefetch_drop(&entries[i]);
+	}
+	return;
+}
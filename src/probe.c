@@ -0,0 +1,425 @@
+/* probe.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "probe.h"
+
+/*
+ * Image dimensions from file headers.
+ *
+ * Preloading, sorting by image properties and the dimension filters only
+ * need the size and format of an image, and getting them through Imlib2
+ * means decoding every pixel. For the common formats, the size is right at
+ * the start of the file, so we read it from there instead. Anything we are
+ * not sure about (unknown formats, and the few cases where Imlib2 may
+ * disagree with the header) is left to a full decode.
+ */
+
+/* JPEG APP segments are at most 64 kB */
+#define PROBE_SEGMENT_MAX 65536
+
+/* stop looking for a PNG tRNS chunk after this many chunks */
+#define PROBE_PNG_CHUNKS_MAX 64
+
+static inline unsigned int be16(const unsigned char *p)
+{
+	return((p[0] << 8) | p[1]);
+}
+
+static inline unsigned int le16(const unsigned char *p)
+{
+	return(p[0] | (p[1] << 8));
+}
+
+static inline unsigned int be32(const unsigned char *p)
+{
+	return(((unsigned int) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+static inline unsigned int le32(const unsigned char *p)
+{
+	return(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24));
+}
+
+static inline unsigned int le24(const unsigned char *p)
+{
+	return(p[0] | (p[1] << 8) | (p[2] << 16));
+}
+
+static int probe_read(FILE * fp, unsigned char *buf, size_t len)
+{
+	return(fread(buf, 1, len, fp) == len);
+}
+
+#ifdef HAVE_LIBEXIF
+/* Returns the Exif orientation in an APP1 segment, or 0 if there is none */
+static int probe_exif_orientation(unsigned char *seg, unsigned int len)
+{
+	unsigned int (*get16)(const unsigned char *);
+	unsigned int (*get32)(const unsigned char *);
+	unsigned int ifd, count, i;
+	unsigned char *tiff;
+
+	if ((len < 14) || memcmp(seg, "Exif\0\0", 6))
+		return(0);
+	tiff = seg + 6;
+	len -= 6;
+
+	if (!memcmp(tiff, "II", 2)) {
+		get16 = le16;
+		get32 = le32;
+	} else if (!memcmp(tiff, "MM", 2)) {
+		get16 = be16;
+		get32 = be32;
+	} else
+		return(0);
+
+	ifd = get32(tiff + 4);
+	if ((ifd > len) || (len - ifd < 2))
+		return(0);
+	count = get16(tiff + ifd);
+
+	for (i = 0; i < count; i++) {
+		unsigned int entry = ifd + 2 + i * 12;
+
+		if (entry + 12 > len)
+			break;
+		if (get16(tiff + entry) == 0x0112)
+			return(get16(tiff + entry + 8));
+	}
+	return(0);
+}
+#endif
+
+static int probe_jpeg(FILE * fp, feh_file_info * info)
+{
+	unsigned char buf[5];
+	unsigned int len;
+	int marker, orientation = 0;
+
+	/* SOI has been checked already */
+	for (;;) {
+		/* markers may be preceded by any number of 0xff fill bytes */
+		if (fgetc(fp) != 0xff)
+			return(0);
+		while ((marker = fgetc(fp)) == 0xff)
+			;
+		if (marker == EOF)
+			return(0);
+
+		/* TEM and RSTn have no payload */
+		if ((marker == 0x01) || ((marker >= 0xd0) && (marker <= 0xd7)))
+			continue;
+		/* EOI or start of scan before any frame header */
+		if ((marker == 0xd9) || (marker == 0xda))
+			return(0);
+
+		if (!probe_read(fp, buf, 2) || ((len = be16(buf)) < 2))
+			return(0);
+		len -= 2;
+
+		/* SOF0 .. SOF15, except DHT, JPG and DAC */
+		if ((marker >= 0xc0) && (marker <= 0xcf) && (marker != 0xc4)
+				&& (marker != 0xc8) && (marker != 0xcc)) {
+			if ((len < 5) || !probe_read(fp, buf, 5))
+				return(0);
+			info->height = be16(buf + 1);
+			info->width = be16(buf + 3);
+			break;
+		}
+
+#ifdef HAVE_LIBEXIF
+		if ((marker == 0xe1) && opt.auto_rotate && !orientation) {
+			unsigned char *seg = emalloc(len);
+
+			if (!probe_read(fp, seg, len)) {
+				free(seg);
+				return(0);
+			}
+			orientation = probe_exif_orientation(seg, len);
+			free(seg);
+			continue;
+		}
+#endif
+
+		if (fseek(fp, len, SEEK_CUR))
+			return(0);
+	}
+
+	/* feh_load_image() turns these by 90 degrees */
+	if ((orientation >= 5) && (orientation <= 8)) {
+		int tmp = info->width;
+
+		info->width = info->height;
+		info->height = tmp;
+	}
+
+	info->has_alpha = 0;
+	info->format = estrdup("jpeg");
+	return(1);
+}
+
+static int probe_png(FILE * fp, feh_file_info * info)
+{
+	unsigned char buf[13];
+	unsigned int len;
+	int i;
+
+	/* the signature has been checked already; IHDR must come first */
+	if (!probe_read(fp, buf, 8) || (be32(buf) != 13) || memcmp(buf + 4, "IHDR", 4))
+		return(0);
+	if (!probe_read(fp, buf, 13) || fseek(fp, 4, SEEK_CUR))
+		return(0);
+
+	info->width = be32(buf);
+	info->height = be32(buf + 4);
+
+	/* gray + alpha and RGBA have an alpha channel ... */
+	info->has_alpha = (buf[9] == 4) || (buf[9] == 6);
+
+	/* ... and so does anything with a tRNS chunk, which precedes IDAT */
+	for (i = 0; !info->has_alpha; i++) {
+		if ((i == PROBE_PNG_CHUNKS_MAX) || !probe_read(fp, buf, 8))
+			return(0);
+		len = be32(buf);
+		if (!memcmp(buf + 4, "tRNS", 4))
+			info->has_alpha = 1;
+		else if (!memcmp(buf + 4, "IDAT", 4) || !memcmp(buf + 4, "IEND", 4))
+			break;
+		else if ((len > 0x7fffffff) || fseek(fp, (long) len + 4, SEEK_CUR))
+			return(0);
+	}
+
+	info->format = estrdup("png");
+	return(1);
+}
+
+static int probe_gif(FILE * fp, feh_file_info * info)
+{
+	unsigned char buf[9];
+	int c, label, flags;
+
+	/* the signature has been checked already */
+	if (!probe_read(fp, buf, 7))
+		return(0);
+	info->width = le16(buf);
+	info->height = le16(buf + 2);
+	info->has_alpha = 0;
+
+	/* global color table */
+	flags = buf[4];
+	if ((flags & 0x80) && fseek(fp, 3 << ((flags & 0x07) + 1), SEEK_CUR))
+		return(0);
+
+	/*
+	 * Transparency is announced in a graphic control extension before the
+	 * first image. If that image does not cover the whole logical screen,
+	 * leave it to Imlib2 to decide which size it reports.
+	 */
+	for (;;) {
+		if ((c = fgetc(fp)) == 0x2c) {
+			if (!probe_read(fp, buf, 9))
+				return(0);
+			if (le16(buf) || le16(buf + 2) || ((int) le16(buf + 4) != info->width)
+					|| ((int) le16(buf + 6) != info->height))
+				return(0);
+			break;
+		} else if (c != 0x21)
+			return(0);
+
+		if ((label = fgetc(fp)) == EOF)
+			return(0);
+
+		/* data sub-blocks up to the block terminator */
+		while ((c = fgetc(fp)) > 0) {
+			if ((label == 0xf9) && (c == 4)) {
+				if (!probe_read(fp, buf, 4))
+					return(0);
+				if (buf[0] & 0x01)
+					info->has_alpha = 1;
+			} else if (fseek(fp, c, SEEK_CUR))
+				return(0);
+		}
+		if (c == EOF)
+			return(0);
+	}
+
+	info->format = estrdup("gif");
+	return(1);
+}
+
+static int probe_bmp(FILE * fp, feh_file_info * info)
+{
+	unsigned char buf[28];
+	int height, bpp;
+
+	/* the signature has been checked already */
+	if (!probe_read(fp, buf, 18))
+		return(0);
+
+	if (le32(buf + 14) == 12) {
+		/* OS/2 BITMAPCOREHEADER */
+		if (!probe_read(fp, buf, 8))
+			return(0);
+		info->width = le16(buf);
+		height = (short) le16(buf + 2);
+		bpp = le16(buf + 6);
+	} else if (le32(buf + 14) >= 40) {
+		if (!probe_read(fp, buf, 12))
+			return(0);
+		info->width = (int) le32(buf);
+		height = (int) le32(buf + 4);
+		bpp = le16(buf + 10);
+	} else
+		return(0);
+
+	/* whether 32 bit bitmaps have alpha depends on the Imlib2 version */
+	if ((bpp == 32) || (info->width <= 0))
+		return(0);
+
+	/* negative heights mark top-down bitmaps */
+	info->height = (height < 0) ? -height : height;
+	info->has_alpha = 0;
+	info->format = estrdup("bmp");
+	return(1);
+}
+
+/* Reads a whitespace and comment separated decimal number from a PNM header */
+static int probe_pnm_number(FILE * fp)
+{
+	int c, n = 0;
+
+	do {
+		if ((c = fgetc(fp)) == '#')
+			while (((c = fgetc(fp)) != '\n') && (c != EOF))
+				;
+	} while (isspace(c));
+
+	if (!isdigit(c))
+		return(-1);
+	for (; isdigit(c); c = fgetc(fp))
+		if ((n = n * 10 + (c - '0')) > 0xffffff)
+			return(-1);
+	return(n);
+}
+
+static int probe_pnm(FILE * fp, feh_file_info * info)
+{
+	/* the signature has been checked already, and is not P7 (PAM) */
+	if (fseek(fp, 2, SEEK_SET))
+		return(0);
+	info->width = probe_pnm_number(fp);
+	info->height = probe_pnm_number(fp);
+	if ((info->width < 0) || (info->height < 0))
+		return(0);
+
+	info->has_alpha = 0;
+	info->format = estrdup("pnm");
+	return(1);
+}
+
+static int probe_webp(FILE * fp, feh_file_info * info)
+{
+	unsigned char buf[10];
+
+	/* "RIFF", size and "WEBP" have been checked already */
+	if (fseek(fp, 12, SEEK_SET) || !probe_read(fp, buf, 8))
+		return(0);
+
+	if (!memcmp(buf, "VP8 ", 4)) {
+		/* frame tag, start code, then 14 bit width and height */
+		if (!probe_read(fp, buf, 10) || memcmp(buf + 3, "\x9d\x01\x2a", 3))
+			return(0);
+		info->width = le16(buf + 6) & 0x3fff;
+		info->height = le16(buf + 8) & 0x3fff;
+		info->has_alpha = 0;
+	} else if (!memcmp(buf, "VP8L", 4)) {
+		unsigned int bits;
+
+		if (!probe_read(fp, buf, 5) || (buf[0] != 0x2f))
+			return(0);
+		bits = le32(buf + 1);
+		info->width = (bits & 0x3fff) + 1;
+		info->height = ((bits >> 14) & 0x3fff) + 1;
+		info->has_alpha = (bits >> 28) & 0x01;
+	} else if (!memcmp(buf, "VP8X", 4)) {
+		if (!probe_read(fp, buf, 10))
+			return(0);
+		info->width = le24(buf + 4) + 1;
+		info->height = le24(buf + 7) + 1;
+		info->has_alpha = (buf[0] & 0x10) ? 1 : 0;
+	} else
+		return(0);
+
+	info->format = estrdup("webp");
+	return(1);
+}
+
+/*
+ * Fill in width, height, has_alpha and format of info from the header of
+ * filename. Returns 1 on success, 0 if the image needs to be decoded.
+ */
+int feh_probe_image_info(char *filename, feh_file_info * info)
+{
+	unsigned char magic[12];
+	FILE *fp;
+	int ret = 0;
+
+	if (!(fp = fopen(filename, "rb")))
+		return(0);
+
+	if (!probe_read(fp, magic, sizeof(magic)) || fseek(fp, 0, SEEK_SET)) {
+		fclose(fp);
+		return(0);
+	}
+
+	if (!memcmp(magic, "\xff\xd8", 2)) {
+		fseek(fp, 2, SEEK_SET);
+		ret = probe_jpeg(fp, info);
+	} else if (!memcmp(magic, "\x89PNG\r\n\x1a\n", 8)) {
+		fseek(fp, 8, SEEK_SET);
+		ret = probe_png(fp, info);
+	} else if (!memcmp(magic, "GIF87a", 6) || !memcmp(magic, "GIF89a", 6)) {
+		fseek(fp, 6, SEEK_SET);
+		ret = probe_gif(fp, info);
+	} else if (!memcmp(magic, "BM", 2))
+		ret = probe_bmp(fp, info);
+	else if ((magic[0] == 'P') && (magic[1] >= '1') && (magic[1] <= '6')
+			&& isspace(magic[2]))
+		ret = probe_pnm(fp, info);
+	else if (!memcmp(magic, "RIFF", 4) && !memcmp(magic + 8, "WEBP", 4))
+		ret = probe_webp(fp, info);
+
+	fclose(fp);
+
+	if (ret && ((info->width <= 0) || (info->height <= 0))) {
+		free(info->format);
+		info->format = NULL;
+		ret = 0;
+	}
+	return(ret);
+}
@@ -30,8 +30,16 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "winwidget.h"
 #include "options.h"
 #include "signals.h"
+#include "sync.h"
+#include "prefetch.h"
+#include "watch.h"
+#include "stream.h"
 #include <time.h>
 
+/* handle of the pending cb_slide_timer, if any */
+static int slide_change_timer = 0;
+static int preroll_timer = 0;
+static int preroll_index = -1;
 
 void init_slideshow_mode(void)
 {
@@ -103,27 +111,13 @@ void init_slideshow_mode(void)
 	if (!opt.title)
 		opt.title = PACKAGE " [%u of %l] - %f";
 
-	gib_list *get_start = filelist;
-	int pic_count = 0;
-	for(; get_start; get_start = get_start->next){
-	  // find file to start at based on time intervals
-	  pic_count++;
-	}
-
-	opt.pic_count = pic_count;
+	opt.pic_count = feh_filelist_length();
 	
-	opt.initial_index = feh_get_pic_index(opt.interval, pic_count);
-	
-	int start_count = 0;
-	for (l = filelist; l; l = l->next)
-	{
-	    if (start_count == opt.initial_index)
-			break;
-	    start_count++;
-	}
+	opt.initial_index = feh_get_pic_index(opt.interval, opt.pic_count);
+	l = feh_filelist_nth(opt.initial_index);
 	
 	mode = "slideshow";
-	for (; l; l = l->next) {
+	for (; l; l = feh_stream_next(l)) {
 		if (last) {
 			filelist = feh_file_remove_from_list(filelist, last);
 			last = NULL;
@@ -133,6 +127,14 @@ void init_slideshow_mode(void)
 			success = 1;
 			winwidget_show(w);
 			opt.w_data = w;
+			feh_prefetch_update(current_file);
+			/* --reload is set up once the filelist is complete */
+			if (feh_stream_active())
+				feh_add_timer(cb_stream_timer, w, 0.0);
+			else if (opt.reload > 0) {
+				feh_watch_init();
+				feh_add_timer(cb_reload_timer, w, opt.reload);
+			}
 			break;
 		} else {
 			last = l;
@@ -150,16 +152,21 @@ void cb_slide_timer(void *data)
 	return;
 }
 
-void cb_reload_timer(void *data)
+/* Rebuild the filelist from scratch */
+static void slideshow_reload_filelist(winwidget w)
 {
 	gib_list *l;
 	char *current_filename;
 
-	winwidget w = (winwidget) data;
+	/* the pre-rolled and prefetched slides point into the list we are about to free */
+	winwidget_free_preroll(w);
+	feh_prefetch_clear();
+	feh_watch_reset();
 
 	/* save the current filename for refinding it in new list */
 	current_filename = estrdup(FEH_FILE(current_file->data)->filename);
 
+	/* O(n), see the feh_file blocks in filelist.c */
 	for (l = filelist; l; l = l->next) {
 		feh_file_free(l->data);
 		l->data = NULL;
@@ -185,6 +192,8 @@ void cb_reload_timer(void *data)
 	}
 
 	feh_prepare_filelist();
+	opt.pic_count = filelist_len;
+	feh_sync_set_playlist(filelist);
 
 	/* find the previously current file */
 	for (l = filelist; l; l = l->next)
@@ -199,8 +208,33 @@ void cb_reload_timer(void *data)
 		current_file = filelist;
 	w->file = current_file;
 
-	feh_reload_image(w, 1, 0);
-	feh_add_unique_timer(cb_reload_timer, w, opt.reload);
+	feh_watch_init();
+	return;
+}
+
+void cb_reload_timer(void *data)
+{
+	winwidget w = (winwidget) data;
+	int changes = feh_watch_apply();
+
+	if (changes < 0)
+		slideshow_reload_filelist(w);
+	else if (changes > 0) {
+		D(("%d files changed\n", changes));
+		if (!filelist_len)
+			eprintf("No files found to reload.");
+		opt.pic_count = filelist_len;
+		feh_sync_set_playlist(filelist);
+		if (!current_file)
+			current_file = filelist;
+		w->file = current_file;
+	}
+
+	if (changes != 0) {
+		feh_reload_image(w, 1, 0);
+		feh_prefetch_update(current_file);
+	}
+	feh_add_timer(cb_reload_timer, w, opt.reload);
 	return;
 }
 
@@ -280,6 +314,24 @@ void feh_reload_image(winwidget w, int resize, int force_new)
 	return;
 }
 
+/* Use the image from the prefetch ring if it is there, load it otherwise */
+static int slideshow_load_image(winwidget winwid, gib_list *file)
+{
+	if ((winwid->im = feh_prefetch_take(file)) != NULL)
+		return(1);
+	return(winwidget_loadimage(winwid, FEH_FILE(file->data)));
+}
+
+/* Hand the outgoing image to the prefetch ring, in case we come back to it */
+static void slideshow_release_image(winwidget winwid)
+{
+	if (winwid->im && winwid->file) {
+		feh_prefetch_give(winwid->file, winwid->im);
+		winwid->im = NULL;
+	}
+	return;
+}
+
 void slideshow_change_image(winwidget winwid, int change, int render)
 {
 	gib_list *last = NULL;
@@ -292,10 +344,14 @@ void slideshow_change_image(winwidget winwid, int change, int render)
 	int our_filelist_len = filelist_len;
 
 	/*
+	 * Time-synchronized slideshows are advanced by the main loop on every
+	 * interval boundary, so only --slideshow-delay needs a timer here.
+	 */
+	feh_remove_timer(slide_change_timer);
+	slide_change_timer = 0;
 	if (opt.slideshow_delay > 0.0)
-		feh_add_timer(cb_slide_timer, winwid, 1, "SLIDE_CHANGE");
-	*/
-	feh_add_timer(cb_slide_timer,winwid,1,"SLIDE_CHANGE");
+		slide_change_timer = feh_add_pausable_timer(cb_slide_timer, winwid,
+				opt.slideshow_delay);
 
 	/* Without this, clicking a one-image slideshow reloads it. Not very *
 	   intelligent behaviour :-) */
@@ -316,6 +372,8 @@ void slideshow_change_image(winwidget winwid, int change, int render)
 		previous_file = NULL;
 	}
 
+	slideshow_release_image(winwid);
+
 	/* The for loop prevents us looping infinitely */
 	for (i = 0; i < our_filelist_len; i++) {
 		winwidget_free_image(winwid);
@@ -415,7 +473,7 @@ void slideshow_change_image(winwidget winwid, int change, int render)
 				current_file = previous_file;
 		}
 
-		if (winwidget_loadimage(winwid, FEH_FILE(current_file->data))) {
+		if (slideshow_load_image(winwid, current_file)) {
 			int w = gib_imlib_image_get_width(winwid->im);
 			int h = gib_imlib_image_get_height(winwid->im);
 			if (feh_should_ignore_image(winwid->im)) {
@@ -442,6 +500,8 @@ void slideshow_change_image(winwidget winwid, int change, int render)
 	if (filelist_len == 0)
 		eprintf("No more slides in show");
 
+	feh_prefetch_update(current_file);
+
 	return;
 }
 
@@ -453,12 +513,18 @@ void slideshow_change_image_by_index(winwidget winwid, int index)
 	 */
 	int our_filelist_len = filelist_len;
 
+	if (index >= 0)
+		slideshow_release_image(winwid);
+
 	/* The for loop prevents us looping infinitely */
 	for (i = 0; i < our_filelist_len; i++) {
-		winwidget_free_image(winwid);
 		current_file = feh_list_jump_to_pic(filelist, current_file, index);
-		
-		if (winwidget_loadimage(winwid, FEH_FILE(current_file->data))) {
+
+		if ((index >= 0) && winwidget_show_preroll(winwid, current_file))
+			break;
+
+		winwidget_free_image(winwid);
+		if (slideshow_load_image(winwid, current_file)) {
 			int w = gib_imlib_image_get_width(winwid->im);
 			int h = gib_imlib_image_get_height(winwid->im);
 			if (feh_should_ignore_image(winwid->im)) {
@@ -482,6 +548,31 @@ void slideshow_change_image_by_index(winwidget winwid, int index)
 	if (filelist_len == 0)
 		eprintf("No more slides in show");
 
+	feh_prefetch_update(current_file);
+
+	return;
+}
+
+static void cb_preroll_timer(void *data)
+{
+	preroll_timer = 0;
+	if (filelist)
+		winwidget_preroll((winwidget) data,
+				feh_list_jump_to_pic(filelist, current_file, preroll_index));
+	return;
+}
+
+/*
+ * Load the image at index ahead of time, so that
+ * slideshow_change_image_by_index only has to show it. This happens from a
+ * zero-length timer so that pending X events (e.g. the Expose for the slide
+ * which was just shown) are handled first.
+ */
+void slideshow_preroll_index(winwidget winwid, int index)
+{
+	feh_remove_timer(preroll_timer);
+	preroll_index = index;
+	preroll_timer = feh_add_timer(cb_preroll_timer, winwid, 0.0);
 	return;
 }
 
@@ -510,7 +601,7 @@ void feh_action_run(feh_file * file, char *action, winwidget winwid)
 	return;
 }
 
-char *format_size(int size)
+char *format_size(long long size)
 {
 	static char ret[5];
 	char units[] = {' ', 'k', 'M', 'G', 'T'};
@@ -519,7 +610,7 @@ char *format_size(int size)
 		size /= 1000;
 		postfix++;
 	}
-	snprintf(ret, 5, "%3d%c", size, units[postfix]);
+	snprintf(ret, 5, "%3d%c", (int) size, units[postfix]);
 	return ret;
 }
 
@@ -559,7 +650,7 @@ char *feh_printf(char *str, feh_file * file, winwidget winwid)
 				}
 				break;
 			case 'l':
-				snprintf(buf, sizeof(buf), "%d", gib_list_length(filelist));
+				snprintf(buf, sizeof(buf), "%d", feh_filelist_length());
 				strncat(ret, buf, sizeof(ret) - strlen(ret) - 1);
 				break;
 			case 'L':
@@ -608,7 +699,7 @@ char *feh_printf(char *str, feh_file * file, winwidget winwid)
 				break;
 			case 's':
 				if (file && (file->info || !feh_file_info_load(file, NULL))) {
-					snprintf(buf, sizeof(buf), "%d", file->info->size);
+					snprintf(buf, sizeof(buf), "%lld", file->info->size);
 					strncat(ret, buf, sizeof(ret) - strlen(ret) - 1);
 				}
 				break;
@@ -624,7 +715,7 @@ char *feh_printf(char *str, feh_file * file, winwidget winwid)
 				break;
 			case 'u':
 				f = current_file ? current_file : gib_list_find_by_data(filelist, file);
-				snprintf(buf, sizeof(buf), "%d", f ? gib_list_num(filelist, f) + 1 : 0);
+				snprintf(buf, sizeof(buf), "%d", f ? feh_filelist_position(f) + 1 : 0);
 				strncat(ret, buf, sizeof(ret) - strlen(ret) - 1);
 				break;
 			case 'v':
@@ -778,9 +869,10 @@ gib_list *feh_list_jump(gib_list * root, gib_list * l, int direction, int num)
 				if (opt.on_last_slide == ON_LAST_SLIDE_QUIT) {
 					exit(0);
 				}
-				if (opt.randomize) {
+				if (opt.randomize && !feh_pic_slots_shuffled()) {
 					/* Randomize the filename order */
 					filelist = gib_list_randomize(filelist);
+					feh_filelist_changed();
 					ret = filelist;
 				} else {
 					ret = root;
@@ -799,25 +891,18 @@ gib_list *feh_list_jump(gib_list * root, gib_list * l, int direction, int num)
 
 gib_list *feh_list_jump_to_pic(gib_list * root, gib_list * l, int index)
 {
-  gib_list *ret = NULL;
-  
-  if (!root)
-    return (NULL);
-  if (!l)
-    return (root);
-
-  ret = root;
-
-  for (int i = 0; i < index; i++) {
-    if (ret->next) {
-      ret = ret->next;
-    }
-    else {
-      ret = root;
-    }
-  }
-
-
-  return ret;
+	gib_list *ret;
+
+	if (!root)
+		return (NULL);
+	if (!l || (index <= 0))
+		return (root);
+
+	if (root == filelist)
+		return (feh_filelist_nth(index % feh_filelist_length()));
+
+	for (ret = root; index > 0; index--)
+		ret = ret->next ? ret->next : root;
+	return (ret);
 }
 
@@ -0,0 +1,321 @@
+/* stream.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "timers.h"
+#include "winwidget.h"
+#include "prefetch.h"
+#include "sync.h"
+#include "watch.h"
+#include "stream.h"
+#include <pthread.h>
+
+/*
+ * Streaming startup (--stream).
+ *
+ * Scanning a large directory tree can take a long time, and normally the
+ * slideshow only starts once the whole filelist is known. With --stream,
+ * the files and directories given on the command line are scanned by a
+ * background thread instead. It hands the paths it finds to the main
+ * thread, which appends them to the filelist in batches. The first image
+ * is shown as soon as it has been found.
+ *
+ * feh_file structures, the filelist and the directory watches are only
+ * touched by the main thread. Once the scan is complete, the requested
+ * sort order is applied to the whole list and --reload is set up. Neither
+ * changes the image currently shown.
+ */
+
+#define STREAM_POLL_INTERVAL 0.1
+
+typedef struct {
+	char **paths;
+	int count;
+	int size;
+} stream_queue;
+
+static pthread_mutex_t stream_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stream_cond = PTHREAD_COND_INITIALIZER;
+
+/* protected by stream_lock */
+static stream_queue stream_files = { NULL, 0, 0 };
+static stream_queue stream_dirs = { NULL, 0, 0 };
+static int stream_scanning = 0;
+
+/* main thread only */
+static gib_list *stream_items = NULL;
+static int stream_active = 0;
+
+static _Thread_local int stream_producer = 0;
+
+/* Whether the given command line arguments may be scanned in the background */
+int feh_stream_possible(int argc, char **argv)
+{
+	int i;
+
+	/*
+	 * Only a slideshow can start with an incomplete filelist. Sort modes
+	 * which need image infos and --start-at need to see all files first,
+	 * and stdin (-) is read by the main thread.
+	 */
+	if (!opt.stream || !feh_slideshow_selected() || opt.start_list_at
+			|| feh_filelist_needs_preload())
+		return(0);
+
+	for (i = 0; i < argc; i++)
+		if (!strcmp(argv[i], "-"))
+			return(0);
+	return(1);
+}
+
+/* Remember a command line argument for the scanner thread */
+void feh_stream_add_item(char *item)
+{
+	stream_items = gib_list_add_front(stream_items, estrdup(item));
+	return;
+}
+
+static void *feh_stream_worker(void *arg __attribute__((unused)))
+{
+	gib_list *l;
+
+	stream_producer = 1;
+	for (l = stream_items; l; l = l->next)
+		add_file_to_filelist_recursively(l->data, FILELIST_FIRST);
+
+	pthread_mutex_lock(&stream_lock);
+	stream_scanning = 0;
+	pthread_cond_signal(&stream_cond);
+	pthread_mutex_unlock(&stream_lock);
+	return(NULL);
+}
+
+void feh_stream_start(void)
+{
+	pthread_t thread;
+	gib_list *l;
+
+	if (!stream_items)
+		return;
+
+	stream_items = gib_list_reverse(stream_items);
+	stream_scanning = 1;
+	if (pthread_create(&thread, NULL, feh_stream_worker, NULL) == 0) {
+		pthread_detach(thread);
+		stream_active = 1;
+		return;
+	}
+
+	/* no thread to be had: scan everything up front */
+	stream_scanning = 0;
+	for (l = stream_items; l; l = l->next)
+		add_file_to_filelist_recursively(l->data, FILELIST_FIRST);
+	gib_list_free_and_data(stream_items);
+	stream_items = NULL;
+	return;
+}
+
+/* Whether the filelist is still being completed by the scanner */
+int feh_stream_active(void)
+{
+	return(stream_active);
+}
+
+/* Whether the calling thread is the scanner */
+int feh_stream_producing(void)
+{
+	return(stream_producer);
+}
+
+static void feh_stream_queue_add(stream_queue * queue, char *path)
+{
+	char *copy = estrdup(path);
+
+	pthread_mutex_lock(&stream_lock);
+	if (queue->count == queue->size) {
+		queue->size = queue->size ? queue->size * 2 : 256;
+		queue->paths = erealloc(queue->paths, queue->size * sizeof(char *));
+	}
+	queue->paths[queue->count++] = copy;
+	if ((queue == &stream_files) && (queue->count == 1))
+		pthread_cond_signal(&stream_cond);
+	pthread_mutex_unlock(&stream_lock);
+	return;
+}
+
+/* Called by the scanner thread for every file it finds */
+void feh_stream_add_file(char *path)
+{
+	feh_stream_queue_add(&stream_files, path);
+	return;
+}
+
+/* Called by the scanner thread for every directory it reads (--reload) */
+void feh_stream_add_dir(char *path)
+{
+	feh_stream_queue_add(&stream_dirs, path);
+	return;
+}
+
+/*
+ * Move the files found so far into the filelist, waiting for at least one
+ * if block is set. Returns the number of new files; *scanning tells whether
+ * the scanner may still find more.
+ */
+static int feh_stream_drain(int block, int *scanning)
+{
+	stream_queue files, dirs;
+	gib_list *head = NULL, *tail = NULL, *l;
+	int i;
+
+	pthread_mutex_lock(&stream_lock);
+	while (block && stream_scanning && !stream_files.count)
+		pthread_cond_wait(&stream_cond, &stream_lock);
+	files = stream_files;
+	dirs = stream_dirs;
+	*scanning = stream_scanning;
+	memset(&stream_files, 0, sizeof(stream_queue));
+	memset(&stream_dirs, 0, sizeof(stream_queue));
+	pthread_mutex_unlock(&stream_lock);
+
+	for (i = 0; i < dirs.count; i++) {
+		feh_watch_add_dir(dirs.paths[i]);
+		free(dirs.paths[i]);
+	}
+	free(dirs.paths);
+
+	if (!files.count)
+		return(0);
+
+	for (i = 0; i < files.count; i++) {
+		l = gib_list_new();
+		l->data = feh_file_new(files.paths[i]);
+		free(files.paths[i]);
+		l->prev = tail;
+		if (tail)
+			tail->next = l;
+		else
+			head = l;
+		tail = l;
+	}
+	free(files.paths);
+
+	/*
+	 * Same order as feh_prepare_filelist would have produced: files are
+	 * appended in the order they were found, unless --reverse without a
+	 * sort mode asks for the opposite.
+	 */
+	if ((opt.sort == SORT_NONE) && !opt.randomize && opt.reverse) {
+		l = head;
+		head = gib_list_reverse(head);
+		tail = l;
+		tail->next = filelist;
+		if (filelist)
+			filelist->prev = tail;
+		filelist = head;
+	} else if (filelist) {
+		l = gib_list_last(filelist);
+		l->next = head;
+		head->prev = l;
+	} else
+		filelist = head;
+
+	filelist_len += files.count;
+	feh_filelist_changed();
+	return(files.count);
+}
+
+/*
+ * Wait until the scanner has found more files or is done. Returns the
+ * number of new files.
+ */
+int feh_stream_wait(void)
+{
+	int scanning;
+
+	if (!stream_active)
+		return(0);
+	return(feh_stream_drain(1, &scanning));
+}
+
+/* l->next, waiting for the scanner if l is the last file found so far */
+gib_list *feh_stream_next(gib_list * l)
+{
+	if (l->next || !stream_active || !feh_stream_wait())
+		return(l->next);
+
+	/* new files may have gone to the front of the list (--reverse) */
+	return(l->next ? l->next : filelist);
+}
+
+static void feh_stream_finish(winwidget w)
+{
+	stream_active = 0;
+	gib_list_free_and_data(stream_items);
+	stream_items = NULL;
+
+	/*
+	 * The part of feh_prepare_filelist which needs all files. The list is
+	 * in scan order already, as feh_prepare_filelist sorts it.
+	 */
+	if (opt.sort != SORT_NONE) {
+		filelist = feh_filelist_sort(filelist, opt.sort);
+		if (opt.reverse)
+			filelist = gib_list_reverse(filelist);
+	} else if (opt.randomize && !feh_pic_slots_shuffled())
+		filelist = gib_list_randomize(filelist);
+	feh_filelist_changed();
+
+	D(("scan finished with %d files\n", filelist_len));
+	opt.pic_count = filelist_len;
+	feh_sync_set_playlist(filelist);
+	w->file = current_file;
+	feh_prefetch_update(current_file);
+
+	if (opt.reload > 0) {
+		feh_watch_init();
+		feh_add_timer(cb_reload_timer, w, opt.reload);
+	}
+	return;
+}
+
+void cb_stream_timer(void *data)
+{
+	winwidget w = (winwidget) data;
+	int scanning;
+
+	if (feh_stream_drain(0, &scanning)) {
+		opt.pic_count = filelist_len;
+		feh_prefetch_update(current_file);
+	}
+
+	if (scanning)
+		feh_add_timer(cb_stream_timer, w, STREAM_POLL_INTERVAL);
+	else
+		feh_stream_finish(w);
+	return;
+}
@@ -0,0 +1,392 @@
+/* sync.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/* struct ip_mreq and IN_MULTICAST are not part of POSIX */
+#define _DEFAULT_SOURCE
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "timers.h"
+#include "sync.h"
+#include <time.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * Slideshow synchronization between feh instances.
+ *
+ * With --sync-leader, feh sends a beacon to the given address whenever its
+ * time-synchronized slideshow enters a new slot. With --sync-follow, feh
+ * listens for these beacons and adjusts its slideshow clock so that its
+ * slot boundaries line up with the leader's, regardless of how well the
+ * system clocks of both machines agree.
+ *
+ * Addresses are either udp:HOST:PORT (HOST may be a multicast group, in
+ * which case any number of followers can listen) or unix:PATH for a Unix
+ * datagram socket bound by a single follower.
+ */
+
+#define SYNC_MAGIC "FEHS"
+#define SYNC_VERSION 1
+#define SYNC_BEACON_SIZE 48
+
+/* exponential moving average weight of a new offset sample: 1/8 */
+#define SYNC_FILTER_SHIFT 3
+
+/* offset changes beyond this are treated as clock steps, not drift */
+#define SYNC_STEP_NS 100000000LL
+
+enum sync_role { SYNC_NONE = 0, SYNC_LEADER, SYNC_FOLLOWER };
+
+struct __feh_sync_beacon {
+	long long slot;
+	long long boundary_ns;
+	long long sent_ns;
+	long long interval_ns;
+	unsigned int playlist_hash;
+	unsigned int pic_count;
+};
+
+static enum sync_role sync_role = SYNC_NONE;
+static int sync_fd = -1;
+static struct sockaddr_storage sync_addr;
+static socklen_t sync_addrlen = 0;
+
+static unsigned int sync_playlist_hash = 0;
+static long long sync_offset_ns = 0;
+static unsigned char sync_locked = 0;
+static unsigned char sync_warned = 0;
+
+static void feh_sync_put64(unsigned char *buf, long long val)
+{
+	unsigned long long v = (unsigned long long) val;
+	int i;
+
+	for (i = 7; i >= 0; i--, v >>= 8)
+		buf[i] = v & 0xff;
+}
+
+static long long feh_sync_get64(unsigned char *buf)
+{
+	unsigned long long v = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		v = (v << 8) | buf[i];
+	return((long long) v);
+}
+
+static void feh_sync_put32(unsigned char *buf, unsigned int val)
+{
+	int i;
+
+	for (i = 3; i >= 0; i--, val >>= 8)
+		buf[i] = val & 0xff;
+}
+
+static unsigned int feh_sync_get32(unsigned char *buf)
+{
+	return(((unsigned int) buf[0] << 24) | ((unsigned int) buf[1] << 16)
+			| ((unsigned int) buf[2] << 8) | buf[3]);
+}
+
+/*
+ * Parse udp:HOST:PORT or unix:PATH into sync_addr. Returns the address
+ * family, or -1 on error.
+ */
+static int feh_sync_parse_addr(char *spec)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *) &sync_addr;
+	struct sockaddr_un *sun = (struct sockaddr_un *) &sync_addr;
+	char *host, *port;
+
+	memset(&sync_addr, 0, sizeof(sync_addr));
+
+	if (!strncmp(spec, "unix:", 5)) {
+		if (strlen(spec + 5) >= sizeof(sun->sun_path)) {
+			weprintf("sync: socket path %s is too long", spec + 5);
+			return(-1);
+		}
+		sun->sun_family = AF_UNIX;
+		strcpy(sun->sun_path, spec + 5);
+		sync_addrlen = sizeof(struct sockaddr_un);
+		return(AF_UNIX);
+	}
+
+	if (strncmp(spec, "udp:", 4) || !(port = strrchr(spec + 4, ':'))) {
+		weprintf("sync: address %s is neither udp:HOST:PORT nor unix:PATH", spec);
+		return(-1);
+	}
+
+	host = estrdup(spec + 4);
+	host[port - (spec + 4)] = '\0';
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(atoi(port + 1));
+	if (inet_pton(AF_INET, host, &sin->sin_addr) != 1) {
+		weprintf("sync: %s is not an IPv4 address", host);
+		free(host);
+		return(-1);
+	}
+	free(host);
+	sync_addrlen = sizeof(struct sockaddr_in);
+	return(AF_INET);
+}
+
+static int feh_sync_open_leader(int family)
+{
+	unsigned char ttl = 1;
+
+	if ((sync_fd = socket(family, SOCK_DGRAM, 0)) < 0) {
+		weprintf("sync: socket:");
+		return(-1);
+	}
+
+	if ((family == AF_INET)
+			&& IN_MULTICAST(ntohl(((struct sockaddr_in *) &sync_addr)->sin_addr.s_addr))
+			&& setsockopt(sync_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)))
+		weprintf("sync: cannot set multicast TTL:");
+
+	return(0);
+}
+
+static int feh_sync_open_follower(int family)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *) &sync_addr;
+	struct sockaddr_in bind_addr;
+	struct ip_mreq mreq;
+	struct stat st;
+	int one = 1;
+
+	if ((sync_fd = socket(family, SOCK_DGRAM, 0)) < 0) {
+		weprintf("sync: socket:");
+		return(-1);
+	}
+
+	if (family == AF_UNIX) {
+		char *path = ((struct sockaddr_un *) &sync_addr)->sun_path;
+
+		/* remove a stale socket from an earlier run, but nothing else */
+		if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+			unlink(path);
+		if (bind(sync_fd, (struct sockaddr *) &sync_addr, sync_addrlen)) {
+			weprintf("sync: bind:");
+			return(-1);
+		}
+		return(0);
+	}
+
+	/* several followers on one host must be able to share the port */
+	setsockopt(sync_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#ifdef SO_REUSEPORT
+	setsockopt(sync_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#endif
+
+	memset(&bind_addr, 0, sizeof(bind_addr));
+	bind_addr.sin_family = AF_INET;
+	bind_addr.sin_port = sin->sin_port;
+	bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sync_fd, (struct sockaddr *) &bind_addr, sizeof(bind_addr))) {
+		weprintf("sync: bind:");
+		return(-1);
+	}
+
+	if (IN_MULTICAST(ntohl(sin->sin_addr.s_addr))) {
+		mreq.imr_multiaddr = sin->sin_addr;
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (setsockopt(sync_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq))) {
+			weprintf("sync: cannot join multicast group:");
+			return(-1);
+		}
+	}
+
+	return(0);
+}
+
+void feh_sync_init(void)
+{
+	char *spec = opt.sync_leader ? opt.sync_leader : opt.sync_follow;
+	int family, ret;
+
+	if (!spec)
+		return;
+
+	if (opt.interval <= 0.0) {
+		weprintf("sync: --sync-leader and --sync-follow require --slideshow-delay");
+		return;
+	}
+
+	if ((family = feh_sync_parse_addr(spec)) < 0)
+		return;
+
+	if (opt.sync_leader)
+		ret = feh_sync_open_leader(family);
+	else
+		ret = feh_sync_open_follower(family);
+
+	if (ret) {
+		if (sync_fd >= 0)
+			close(sync_fd);
+		sync_fd = -1;
+		weprintf("sync: continuing without slideshow synchronization");
+		return;
+	}
+
+	fcntl(sync_fd, F_SETFD, FD_CLOEXEC);
+	fcntl(sync_fd, F_SETFL, fcntl(sync_fd, F_GETFL) | O_NONBLOCK);
+	sync_role = opt.sync_leader ? SYNC_LEADER : SYNC_FOLLOWER;
+	feh_sync_set_playlist(filelist);
+}
+
+/*
+ * Beacons carry a hash of the filelist so that a follower showing a
+ * different playlist does not lock onto a leader it cannot match anyway.
+ */
+void feh_sync_set_playlist(gib_list * list)
+{
+	unsigned int hash = 2166136261U;
+	unsigned char *c;
+
+	for (; list; list = list->next) {
+		for (c = (unsigned char *) FEH_FILE(list->data)->filename; *c; c++)
+			hash = (hash ^ *c) * 16777619U;
+		hash = (hash ^ '\n') * 16777619U;
+	}
+	sync_playlist_hash = hash;
+	sync_warned = 0;
+}
+
+int feh_sync_get_fd(void)
+{
+	return((sync_role == SYNC_FOLLOWER) ? sync_fd : -1);
+}
+
+int feh_sync_is_follower(void)
+{
+	return(sync_role == SYNC_FOLLOWER);
+}
+
+long long feh_sync_get_offset_ns(void)
+{
+	return(sync_offset_ns);
+}
+
+/*
+ * Read all pending beacons. Returns 1 if the slideshow clock was adjusted,
+ * in which case the slide timer needs to be re-armed.
+ */
+int feh_sync_receive(void)
+{
+	struct __feh_sync_beacon b;
+	unsigned char buf[SYNC_BEACON_SIZE];
+	long long sample;
+	int changed = 0;
+
+	if (sync_role != SYNC_FOLLOWER)
+		return(0);
+
+	while (recv(sync_fd, buf, sizeof(buf), 0) == SYNC_BEACON_SIZE) {
+		if (memcmp(buf, SYNC_MAGIC, 4) || (feh_sync_get32(buf + 4) != SYNC_VERSION))
+			continue;
+
+		b.slot = feh_sync_get64(buf + 8);
+		b.boundary_ns = feh_sync_get64(buf + 16);
+		b.sent_ns = feh_sync_get64(buf + 24);
+		b.interval_ns = feh_sync_get64(buf + 32);
+		b.playlist_hash = feh_sync_get32(buf + 40);
+		b.pic_count = feh_sync_get32(buf + 44);
+
+		if ((b.playlist_hash != sync_playlist_hash)
+				|| (b.interval_ns != feh_interval_ns(opt.interval))) {
+			if (!sync_warned)
+				weprintf("sync: leader uses a different filelist or slideshow "
+						"delay, ignoring it");
+			sync_warned = 1;
+			continue;
+		}
+
+		/*
+		 * The sample still contains the network latency, which is
+		 * negligible on a LAN compared to NTP errors. The moving average
+		 * smoothes out scheduling jitter; clock steps are applied at once.
+		 */
+		sample = b.sent_ns - (feh_get_sync_clock_ns(NULL) - sync_offset_ns);
+		if (!sync_locked || (llabs(sample - sync_offset_ns) > SYNC_STEP_NS)) {
+			D(("sync: locking to leader, offset %lld ns\n", sample));
+			sync_offset_ns = sample;
+			sync_locked = 1;
+		} else
+			sync_offset_ns += (sample - sync_offset_ns) / (1 << SYNC_FILTER_SHIFT);
+
+		D(("sync: slot %lld, offset %lld ns\n", b.slot, sync_offset_ns));
+		changed = 1;
+	}
+
+	return(changed);
+}
+
+/*
+ * Called as soon as a new slot begins, before its image is loaded, so that
+ * the beacon timestamp is not delayed by decoding and rendering.
+ */
+void feh_sync_slot_changed(long long slot)
+{
+	unsigned char buf[SYNC_BEACON_SIZE];
+	long long interval_ns;
+
+	if (sync_role != SYNC_LEADER)
+		return;
+
+	interval_ns = feh_interval_ns(opt.interval);
+
+	memcpy(buf, SYNC_MAGIC, 4);
+	feh_sync_put32(buf + 4, SYNC_VERSION);
+	feh_sync_put64(buf + 8, slot);
+	feh_sync_put64(buf + 16, slot * interval_ns
+			+ llround(opt.sync_phase * (double) interval_ns));
+	feh_sync_put64(buf + 32, interval_ns);
+	feh_sync_put32(buf + 40, sync_playlist_hash);
+	feh_sync_put32(buf + 44, opt.pic_count);
+	feh_sync_put64(buf + 24, feh_get_sync_clock_ns(NULL));
+
+	if (sendto(sync_fd, buf, sizeof(buf), 0, (struct sockaddr *) &sync_addr,
+				sync_addrlen) != sizeof(buf)) {
+		D(("sync: sendto failed: %s\n", strerror(errno)));
+	}
+}
+
+/* Called once the image of a new slot has been rendered */
+void feh_sync_slot_shown(long long slot)
+{
+	struct timespec rt;
+
+	if (!opt.verbose)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	fprintf(stderr, "sync: slot %lld shown at %lld.%09ld\n", slot,
+			(long long) rt.tv_sec, rt.tv_nsec);
+}
@@ -25,42 +25,429 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include "feh.h"
+#include "filelist.h"
 #include "options.h"
 #include "timers.h"
+#include "sync.h"
+#include <time.h>
 
-fehtimer first_timer = NULL;
+#ifdef HAVE_TIMERFD
+#include <sys/timerfd.h>
+
+/* Not exposed by older C libraries, but understood by Linux >= 3.0 */
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
+static int slide_timer_fd = -1;
+#endif
+
+/*
+ * Timers live in a binary min-heap ordered by their (absolute, monotonic)
+ * expiry time. Each timer also owns a slot which remembers its position in
+ * the heap, so it can be cancelled in O(log n) via the handle returned by
+ * feh_add_timer. A handle combines the slot number with a per-slot serial
+ * number, so stale handles of timers which have already fired are harmless.
+ */
+#define TIMER_SLOT_BITS 16
+#define TIMER_SLOT_MASK ((1 << TIMER_SLOT_BITS) - 1)
+#define TIMER_SERIAL_MAX 0x7fff
+
+struct __fehtimer_slot {
+	int pos;		/* index into timer_heap, -1 if unused */
+	int next_free;
+	int serial;
+};
+
+static _fehtimer *timer_heap = NULL;
+static int timer_count = 0;
+static int timer_heap_size = 0;
+
+static struct __fehtimer_slot *timer_slots = NULL;
+static int timer_slot_count = 0;
+static int timer_slot_free = -1;
+
+static double feh_get_monotonic_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((double) ts.tv_sec + ((double) ts.tv_nsec / 1000000000.0));
+}
+
+static void feh_timer_heap_set(int pos, _fehtimer *ft)
+{
+	timer_heap[pos] = *ft;
+	timer_slots[ft->slot].pos = pos;
+}
+
+static void feh_timer_sift_up(int pos)
+{
+	_fehtimer ft = timer_heap[pos];
+	int parent;
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (timer_heap[parent].when <= ft.when)
+			break;
+		feh_timer_heap_set(pos, &timer_heap[parent]);
+		pos = parent;
+	}
+	feh_timer_heap_set(pos, &ft);
+}
+
+static void feh_timer_sift_down(int pos)
+{
+	_fehtimer ft = timer_heap[pos];
+	int child;
+
+	while ((child = 2 * pos + 1) < timer_count) {
+		if ((child + 1 < timer_count)
+				&& (timer_heap[child + 1].when < timer_heap[child].when))
+			child++;
+		if (ft.when <= timer_heap[child].when)
+			break;
+		feh_timer_heap_set(pos, &timer_heap[child]);
+		pos = child;
+	}
+	feh_timer_heap_set(pos, &ft);
+}
+
+/* Remove the timer at heap position pos and release its slot */
+static void feh_timer_delete(int pos)
+{
+	int slot = timer_heap[pos].slot;
+
+	timer_slots[slot].pos = -1;
+	timer_slots[slot].next_free = timer_slot_free;
+	timer_slot_free = slot;
+
+	if (--timer_count == pos)
+		return;
+
+	feh_timer_heap_set(pos, &timer_heap[timer_count]);
+	if ((pos > 0) && (timer_heap[(pos - 1) / 2].when > timer_heap[pos].when))
+		feh_timer_sift_up(pos);
+	else
+		feh_timer_sift_down(pos);
+}
+
+static int feh_timer_held(_fehtimer *ft)
+{
+	return(ft->pausable && ((opt.mode != MODE_NORMAL) || opt.paused));
+}
+
+/*
+ * Heap position of the first timer which may run now, -1 if there is none.
+ * Held timers stay in the heap, so while one of them is at the top the
+ * others are searched linearly. There are only ever a handful of timers.
+ */
+static int feh_timer_next(void)
+{
+	int pos, next = -1;
+
+	if (!timer_count || !feh_timer_held(&timer_heap[0]))
+		return(timer_count ? 0 : -1);
+
+	for (pos = 1; pos < timer_count; pos++)
+		if (!feh_timer_held(&timer_heap[pos])
+				&& ((next < 0) || (timer_heap[pos].when < timer_heap[next].when)))
+			next = pos;
+	return(next);
+}
 
 void feh_handle_timer(void)
 {
-	fehtimer ft;
+	_fehtimer ft;
+	double now;
+	int todo, pos;
 
-	if (!first_timer) {
+	if (!timer_count) {
 		D(("No timer to handle, returning\n"));
 		return;
 	}
-	ft = first_timer;
-	first_timer = first_timer->next;
-	D(("Executing timer function now\n"));
-	(*(ft->func)) (ft->data);
-	D(("Freeing the timer\n"));
-	if (ft && ft->name)
-		free(ft->name);
-	if (ft)
-		free(ft);
+
+	/*
+	 * Only run timers which were already due when we got here. A callback
+	 * adding another timer with a zero timeout must not starve the event
+	 * loop.
+	 */
+	now = feh_get_monotonic_time();
+	for (todo = timer_count; todo && ((pos = feh_timer_next()) >= 0)
+			&& (timer_heap[pos].when <= now); todo--) {
+		ft = timer_heap[pos];
+		feh_timer_delete(pos);
+		D(("Executing timer function now\n"));
+		(*(ft.func)) (ft.data);
+	}
 	return;
 }
 
+double feh_get_timer_timeout(void)
+{
+	double t;
+	int pos;
+
+	if ((pos = feh_timer_next()) < 0)
+		return(-1.0);
+
+	t = timer_heap[pos].when - feh_get_monotonic_time();
+	return((t < 0.0) ? 0.0 : t);
+}
+
+/*
+ * The time-synchronized slideshow runs on its own clock: opt.sync_clock
+ * (CLOCK_REALTIME by default) minus opt.sync_epoch_ns, corrected by the
+ * offset to a --sync-follow leader (if any) and delayed by opt.sync_phase
+ * slots. Slot n starts at n * interval on this clock. Everything is
+ * computed in integer nanoseconds so that all feh instances showing the
+ * same filelist agree on the slot boundaries.
+ */
+long long feh_interval_ns(double interval)
+{
+	long long interval_ns = llround(interval * 1000000000.0);
+
+	return((interval_ns > 0) ? interval_ns : 1);
+}
+
+static long long feh_floor_div(long long a, long long b)
+{
+	long long q = a / b;
+
+	if ((a % b) && (a < 0))
+		q--;
+	return(q);
+}
+
+/*
+ * Current time on the slideshow clock, not including the --sync-phase
+ * delay. If realtime is non-NULL, it receives the CLOCK_REALTIME reading
+ * taken at (nearly) the same moment.
+ */
+long long feh_get_sync_clock_ns(struct timespec *realtime)
+{
+	struct timespec now;
+
+	if (clock_gettime(opt.sync_clock, &now) != 0)
+		eprintf("clock_gettime failed for the slideshow clock:");
+
+	if (realtime) {
+		if (opt.sync_clock == CLOCK_REALTIME)
+			*realtime = now;
+		else
+			clock_gettime(CLOCK_REALTIME, realtime);
+	}
+
+	return((long long) now.tv_sec * 1000000000LL + now.tv_nsec
+			- opt.sync_epoch_ns + feh_sync_get_offset_ns());
+}
+
+static long long feh_get_sync_time_ns(double interval, struct timespec *realtime)
+{
+	return(feh_get_sync_clock_ns(realtime)
+			- llround(opt.sync_phase * (double) feh_interval_ns(interval)));
+}
+
+long long feh_get_pic_slot(double interval)
+{
+	return(feh_floor_div(feh_get_sync_time_ns(interval, NULL), feh_interval_ns(interval)));
+}
+
+/*
+ * --randomize in a timed slideshow. Shuffling the filelist would give every
+ * feh instance a different order, and reshuffling it after each pass would
+ * break the mapping from slots to images. Instead, the filelist keeps its
+ * scan order, and the slots of each pass through it are mapped to images by
+ * a permutation keyed with the pass number and --sync-seed. Every instance
+ * computes the same image for a slot, without any state.
+ */
+int feh_pic_slots_shuffled(void)
+{
+	return(opt.randomize && (opt.sort == SORT_NONE) && (opt.interval > 0.0)
+			&& feh_slideshow_selected());
+}
+
+/* splitmix64 finalizer */
+static unsigned long long feh_mix64(unsigned long long x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return(x);
+}
+
+/*
+ * A bijection on [0, count): a four round Feistel network on the smallest
+ * power of four which is not below count. Values outside the range are
+ * encrypted again until they fall inside it (cycle walking). As the network
+ * covers less than 4 * count values, this takes less than four passes on
+ * average.
+ */
+static int feh_pic_permute(int index, int count, unsigned long long key)
+{
+	unsigned int bits = 1, mask, left, right, tmp;
+	unsigned int x = index;
+	int round;
+
+	while ((1ULL << (2 * bits)) < (unsigned int) count)
+		bits++;
+	mask = (1U << bits) - 1;
+
+	do {
+		left = x >> bits;
+		right = x & mask;
+		for (round = 0; round < 4; round++) {
+			tmp = left ^ (feh_mix64(key + round * 0x9e3779b97f4a7c15ULL + right) & mask);
+			left = right;
+			right = tmp;
+		}
+		x = (left << bits) | right;
+	} while (x >= (unsigned int) count);
+
+	return(x);
+}
+
+int feh_pic_slot_to_index(long long slot, int numPics)
+{
+	long long pass;
+	int index;
+
+	if (numPics <= 0)
+		return(0);
+
+	index = slot % numPics;
+	pass = slot / numPics;
+	if (index < 0) {
+		index += numPics;
+		pass--;
+	}
+
+	if (feh_pic_slots_shuffled())
+		index = feh_pic_permute(index, numPics,
+				feh_mix64(opt.sync_seed ^ feh_mix64(pass)));
+
+	return(index);
+}
+
 int feh_get_pic_index(double interval, int numPics)
 {
-  int index = 0;
-  struct timeval tv;
+	return(feh_pic_slot_to_index(feh_get_pic_slot(interval), numPics));
+}
+
+/*
+ * Nanoseconds until the slide index returned by feh_get_pic_index()
+ * changes. If realtime is non-NULL, it receives the CLOCK_REALTIME time of
+ * that boundary, suitable for an absolute timer.
+ */
+static long long feh_get_next_pic_boundary(double interval, struct timespec *realtime)
+{
+	long long interval_ns = feh_interval_ns(interval);
+	long long now_ns, delta_ns, rt_ns;
+	struct timespec rt;
+
+	now_ns = feh_get_sync_time_ns(interval, &rt);
+	delta_ns = (feh_floor_div(now_ns, interval_ns) + 1) * interval_ns - now_ns;
+
+	if (realtime) {
+		rt_ns = (long long) rt.tv_sec * 1000000000LL + rt.tv_nsec + delta_ns;
+		realtime->tv_sec = rt_ns / 1000000000LL;
+		realtime->tv_nsec = rt_ns % 1000000000LL;
+	}
+
+	return(delta_ns);
+}
+
+double feh_get_time_to_next_pic(double interval)
+{
+	if (interval <= 0.0)
+		return(0.0);
+
+	return((double) feh_get_next_pic_boundary(interval, NULL) / 1000000000.0);
+}
+
+/*
+ * Arm a timer which expires on every slide boundary (see
+ * feh_get_next_pic_boundary). Returns a file descriptor which becomes
+ * readable on expiry, or -1 if no such timer is available. In that case,
+ * callers should use feh_get_time_to_next_pic as a poll timeout instead.
+ */
+int feh_slide_timer_arm(double interval)
+{
+#ifdef HAVE_TIMERFD
+	struct itimerspec its;
+
+	if (interval <= 0.0)
+		return(-1);
+
+	if (slide_timer_fd < 0) {
+		slide_timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (slide_timer_fd < 0) {
+			weprintf("timerfd_create failed, falling back to poll timeouts:");
+			return(-1);
+		}
+	}
+
+	/*
+	 * The boundary is converted to CLOCK_REALTIME, since timerfd does not
+	 * support CLOCK_TAI. A change of the TAI offset (leap second) steps
+	 * the realtime clock and thus re-arms the timer.
+	 */
+	feh_get_next_pic_boundary(interval, &its.it_value);
+	its.it_interval.tv_sec = feh_interval_ns(interval) / 1000000000LL;
+	its.it_interval.tv_nsec = feh_interval_ns(interval) % 1000000000LL;
+
+	/*
+	 * TFD_TIMER_CANCEL_ON_SET makes read() fail with ECANCELED whenever
+	 * the realtime clock is stepped (e.g. by NTP or date -s), which is our
+	 * cue to recompute the boundary.
+	 */
+	if (timerfd_settime(slide_timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+				&its, NULL) != 0) {
+		if ((errno != EINVAL) || (timerfd_settime(slide_timer_fd,
+						TFD_TIMER_ABSTIME, &its, NULL) != 0)) {
+			weprintf("timerfd_settime failed, falling back to poll timeouts:");
+			close(slide_timer_fd);
+			slide_timer_fd = -1;
+			return(-1);
+		}
+	}
+
+	D(("slide timer armed for %ld.%09ld\n", (long) its.it_value.tv_sec,
+		its.it_value.tv_nsec));
+	return(slide_timer_fd);
+#else
+	(void) interval;
+	return(-1);
+#endif
+}
+
+/*
+ * Acknowledge an expiry of the slide timer after its file descriptor became
+ * readable. Returns 1 if a slide boundary passed and 0 if the clock was
+ * stepped instead, in which case the timer has been re-armed.
+ */
+int feh_slide_timer_ack(double interval)
+{
+#ifdef HAVE_TIMERFD
+	unsigned long long expirations;
+
+	if (slide_timer_fd < 0)
+		return(0);
+
+	if (read(slide_timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+		return(1);
 
-  gettimeofday(&tv, NULL);
-  int time_sec = tv.tv_sec;
-  int intervalIndex = floor((time_sec - (time_sec % (int)interval))/interval);
-  index = intervalIndex % numPics;
-  
-  return index;
+	if (errno == ECANCELED) {
+		D(("realtime clock was set, re-arming slide timer\n"));
+		feh_slide_timer_arm(interval);
+	}
+	return(0);
+#else
+	(void) interval;
+	return(0);
+#endif
 }
 
 double feh_get_time(void)
@@ -71,97 +458,70 @@ double feh_get_time(void)
 	return((double) timev.tv_sec + (((double) timev.tv_usec) / 1000000));
 }
 
-void feh_remove_timer(char *name)
-{
-	fehtimer ft, ptr, pptr;
-
-	D(("removing %s\n", name));
-	pptr = NULL;
-	ptr = first_timer;
-	while (ptr) {
-		D(("Stepping through event list\n"));
-		ft = ptr;
-		if (!strcmp(ft->name, name)) {
-			D(("Found it. Removing\n"));
-			if (pptr)
-				pptr->next = ft->next;
-			else
-				first_timer = ft->next;
-			if (ft->next)
-				ft->next->in += ft->in;
-			if (ft->name)
-				free(ft->name);
-			if (ft)
-				free(ft);
-			return;
-		}
-		pptr = ptr;
-		ptr = ptr->next;
+void feh_remove_timer(int handle)
+{
+	int slot = handle & TIMER_SLOT_MASK;
+
+	if ((handle <= 0) || (slot >= timer_slot_count)
+			|| (timer_slots[slot].pos < 0)
+			|| (timer_slots[slot].serial != (handle >> TIMER_SLOT_BITS))) {
+		D(("timer %d is not active\n", handle));
+		return;
 	}
+
+	D(("removing timer %d\n", handle));
+	feh_timer_delete(timer_slots[slot].pos);
 	return;
 }
 
-void feh_add_timer(void (*func) (void *data), void *data, double in, char *name)
-{
-	fehtimer ft, ptr, pptr;
-	double tally;
-
-	D(("adding timer %s for %f seconds time\n", name, in));
-	feh_remove_timer(name);
-	ft = emalloc(sizeof(_fehtimer));
-	ft->next = NULL;
-	ft->func = func;
-	ft->data = data;
-	ft->name = estrdup(name);
-	ft->just_added = 1;
-	ft->in = in;
-	D(("ft->in = %f\n", ft->in));
-	if (!first_timer) {
-		D(("No first timer\n"));
-		first_timer = ft;
-	} else {
-		D(("There is a first timer\n"));
-		pptr = NULL;
-		ptr = first_timer;
-		tally = 0.0;
-		while (ptr) {
-			tally += ptr->in;
-			if (tally > in) {
-				tally -= ptr->in;
-				ft->next = ptr;
-				if (pptr)
-					pptr->next = ft;
-				else
-					first_timer = ft;
-				ft->in -= tally;
-				if (ft->next)
-					ft->next->in -= ft->in;
-				return;
-			}
-			pptr = ptr;
-			ptr = ptr->next;
-		}
-		if (pptr)
-			pptr->next = ft;
-		else
-			first_timer = ft;
-		ft->in -= tally;
+static int feh_timer_add(void (*func) (void *data), void *data, double in,
+		int pausable)
+{
+	_fehtimer ft;
+	int slot;
+
+	D(("adding timer for %f seconds time\n", in));
+
+	if (timer_slot_free < 0) {
+		if (timer_slot_count > TIMER_SLOT_MASK)
+			eprintf("Too many timers");
+		timer_slots = erealloc(timer_slots,
+				(timer_slot_count + 1) * sizeof(struct __fehtimer_slot));
+		timer_slots[timer_slot_count].serial = 0;
+		timer_slots[timer_slot_count].next_free = -1;
+		timer_slot_free = timer_slot_count++;
 	}
-	D(("ft->in = %f\n", ft->in));
-	return;
+	slot = timer_slot_free;
+	timer_slot_free = timer_slots[slot].next_free;
+
+	if (++timer_slots[slot].serial > TIMER_SERIAL_MAX)
+		timer_slots[slot].serial = 1;
+
+	if (timer_count == timer_heap_size) {
+		timer_heap_size = timer_heap_size ? timer_heap_size * 2 : 8;
+		timer_heap = erealloc(timer_heap, timer_heap_size * sizeof(_fehtimer));
+	}
+
+	ft.when = feh_get_monotonic_time() + ((in > 0.0) ? in : 0.0);
+	ft.func = func;
+	ft.data = data;
+	ft.slot = slot;
+	ft.pausable = pausable;
+
+	timer_heap[timer_count] = ft;
+	timer_slots[slot].pos = timer_count;
+	feh_timer_sift_up(timer_count++);
+
+	return((timer_slots[slot].serial << TIMER_SLOT_BITS) | slot);
 }
 
-void feh_add_unique_timer(void (*func) (void *data), void *data, double in)
+int feh_add_timer(void (*func) (void *data), void *data, double in)
 {
-	static long i = 0;
-	char evname[20];
+	return(feh_timer_add(func, data, in, 0));
+}
 
-	snprintf(evname, sizeof(evname), "T_%ld", i);
-	D(("adding timer with unique name %s\n", evname));
-	feh_add_timer(func, data, in, evname);
-	i++;
-	/* Mega paranoia ;) */
-	if (i > 1000000)
-		i = 0;
-	return;
+/* A timer which does not fire while zooming, panning etc. or paused */
+int feh_add_pausable_timer(void (*func) (void *data), void *data, double in)
+{
+	return(feh_timer_add(func, data, in, 1));
 }
@@ -27,21 +27,28 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define TIMERS_H
 
 struct __fehtimer {
-	char *name;
+	double when;
 	void (*func) (void *data);
 	void *data;
-	double in;
-	char just_added;
-	fehtimer next;
+	int slot;
+	/* held while zooming, panning etc. or paused */
+	int pausable;
 };
 
 void feh_handle_timer(void);
+double feh_get_timer_timeout(void);
 double feh_get_time(void);
-void feh_remove_timer(char *name);
-void feh_add_timer(void (*func) (void *data), void *data, double in, char *name);
-void feh_add_unique_timer(void (*func) (void *data), void *data, double in);
+void feh_remove_timer(int handle);
+int feh_add_timer(void (*func) (void *data), void *data, double in);
+int feh_add_pausable_timer(void (*func) (void *data), void *data, double in);
+long long feh_interval_ns(double interval);
+long long feh_get_sync_clock_ns(struct timespec *realtime);
+long long feh_get_pic_slot(double interval);
+int feh_pic_slots_shuffled(void);
+int feh_pic_slot_to_index(long long slot, int numPics);
 int feh_get_pic_index(double interval, int numPics);
-
-extern fehtimer first_timer;
+double feh_get_time_to_next_pic(double interval);
+int feh_slide_timer_arm(double interval);
+int feh_slide_timer_ack(double interval);
 
 #endif
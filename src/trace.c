@@ -0,0 +1,271 @@
+/* trace.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "options.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Timeline tracing (--trace).
+ *
+ * Spans are written as "complete" events of the Chrome Trace Event format,
+ * which chrome://tracing and ui.perfetto.dev can load. The file uses the
+ * JSON array format, which may be truncated: a trace is still readable if
+ * feh crashes or is killed.
+ *
+ * Each thread records into a buffer of its own without taking any locks.
+ * A buffer is written out by its thread when it is full, and by the main
+ * thread on exit; only these writes are serialized.
+ */
+
+#define TRACE_BUFFER_SIZE 4096
+#define TRACE_ARG_SIZE 96
+
+typedef struct {
+	const char *name;
+	long long begin_ns;
+	long long dur_ns;
+	char arg[TRACE_ARG_SIZE];
+} feh_trace_event;
+
+typedef struct __feh_trace_buffer feh_trace_buffer;
+
+struct __feh_trace_buffer {
+	int tid;
+	/* events [flushed, count) are waiting to be written */
+	atomic_int count;
+	int flushed;
+	feh_trace_event events[TRACE_BUFFER_SIZE];
+	feh_trace_buffer *next;
+};
+
+static long long trace_start_ns = 0;
+static int trace_pid = 0;
+
+/* checked without trace_lock to skip recording; trace_fp has the final word */
+static atomic_int trace_enabled = 0;
+
+/* protects trace_fp, buffer_list, next_tid and all flushed counters */
+static FILE *trace_fp = NULL;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static feh_trace_buffer *buffer_list = NULL;
+static int next_tid = 1;
+
+static _Thread_local feh_trace_buffer *thread_buffer = NULL;
+
+static feh_trace_buffer *feh_trace_thread_buffer(void);
+
+static long long feh_trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+void feh_trace_init(void)
+{
+	if (!opt.trace_file)
+		return;
+
+	if (!(trace_fp = fopen(opt.trace_file, "w"))) {
+		weprintf("--trace: cannot open %s:", opt.trace_file);
+		return;
+	}
+
+	trace_start_ns = feh_trace_now();
+	trace_pid = getpid();
+	fprintf(trace_fp, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+			"\"tid\":1,\"args\":{\"name\":\"feh\"}},\n", trace_pid);
+	feh_trace_thread_buffer();
+	atomic_store(&trace_enabled, 1);
+	return;
+}
+
+/* Returns a timestamp to pass to feh_trace_end, or 0 if tracing is off */
+long long feh_trace_begin(void)
+{
+	return(atomic_load_explicit(&trace_enabled, memory_order_relaxed) ? feh_trace_now() : 0);
+}
+
+static void feh_trace_write_string(const char *s)
+{
+	for (; *s; s++) {
+		if ((*s == '"') || (*s == '\\'))
+			fprintf(trace_fp, "\\%c", *s);
+		else if ((unsigned char) *s < 0x20)
+			fprintf(trace_fp, "\\u%04x", *s);
+		else
+			fputc(*s, trace_fp);
+	}
+	return;
+}
+
+/* Write out the pending events of buf. Must be called with trace_lock held. */
+static void feh_trace_write_buffer(feh_trace_buffer *buf)
+{
+	feh_trace_event *ev;
+	int count = atomic_load_explicit(&buf->count, memory_order_acquire);
+
+	for (; buf->flushed < count; buf->flushed++) {
+		ev = &buf->events[buf->flushed];
+		fprintf(trace_fp, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+				"\"pid\":%d,\"tid\":%d", ev->name,
+				(ev->begin_ns - trace_start_ns) / 1000.0, ev->dur_ns / 1000.0,
+				trace_pid, buf->tid);
+		if (ev->arg[0]) {
+			fputs(",\"args\":{\"arg\":\"", trace_fp);
+			feh_trace_write_string(ev->arg);
+			fputs("\"}", trace_fp);
+		}
+		fputs("},\n", trace_fp);
+	}
+	return;
+}
+
+/* The first thread to record an event (i.e. the main thread) gets tid 1 */
+static feh_trace_buffer *feh_trace_thread_buffer(void)
+{
+	feh_trace_buffer *buf;
+
+	if (thread_buffer)
+		return(thread_buffer);
+
+	buf = emalloc(sizeof(feh_trace_buffer));
+	atomic_init(&buf->count, 0);
+	buf->flushed = 0;
+
+	pthread_mutex_lock(&trace_lock);
+	buf->tid = next_tid++;
+	buf->next = buffer_list;
+	buffer_list = buf;
+	if (trace_fp && (buf->tid > 1))
+		fprintf(trace_fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+				"\"tid\":%d,\"args\":{\"name\":\"worker %d\"}},\n",
+				trace_pid, buf->tid, buf->tid - 1);
+	pthread_mutex_unlock(&trace_lock);
+
+	thread_buffer = buf;
+	return(buf);
+}
+
+/*
+ * Record a span called name (which must be a string constant) from begin
+ * until now. arg, if not NULL, is shown as the span's argument (usually a
+ * file name) and may be truncated.
+ */
+void feh_trace_end(const char *name, const char *arg, long long begin)
+{
+	feh_trace_buffer *buf;
+	feh_trace_event *ev;
+	int count;
+
+	if (!begin || !atomic_load_explicit(&trace_enabled, memory_order_relaxed))
+		return;
+
+	buf = feh_trace_thread_buffer();
+	count = atomic_load_explicit(&buf->count, memory_order_relaxed);
+
+	if (count == TRACE_BUFFER_SIZE) {
+		pthread_mutex_lock(&trace_lock);
+		/* the trace may have been closed in the meantime */
+		if (!trace_fp) {
+			pthread_mutex_unlock(&trace_lock);
+			return;
+		}
+		feh_trace_write_buffer(buf);
+		fflush(trace_fp);
+		buf->flushed = 0;
+		atomic_store_explicit(&buf->count, 0, memory_order_relaxed);
+		pthread_mutex_unlock(&trace_lock);
+		count = 0;
+	}
+
+	ev = &buf->events[count];
+	ev->name = name;
+	ev->begin_ns = begin;
+	ev->dur_ns = feh_trace_now() - begin;
+	ev->arg[0] = '\0';
+	if (arg) {
+		strncpy(ev->arg, arg, TRACE_ARG_SIZE - 1);
+		ev->arg[TRACE_ARG_SIZE - 1] = '\0';
+	}
+	atomic_store_explicit(&buf->count, count + 1, memory_order_release);
+	return;
+}
+
+/* Write all pending events and terminate the trace. Called on exit. */
+void feh_trace_flush(void)
+{
+	feh_trace_buffer *buf;
+
+	if (!atomic_load(&trace_enabled))
+		return;
+
+	pthread_mutex_lock(&trace_lock);
+	atomic_store(&trace_enabled, 0);
+	if (!trace_fp) {
+		pthread_mutex_unlock(&trace_lock);
+		return;
+	}
+	for (buf = buffer_list; buf; buf = buf->next)
+		feh_trace_write_buffer(buf);
+	fprintf(trace_fp, "{\"name\":\"exit\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,"
+			"\"pid\":%d,\"tid\":1}\n]\n",
+			(feh_trace_now() - trace_start_ns) / 1000.0, trace_pid);
+	fclose(trace_fp);
+	trace_fp = NULL;
+	pthread_mutex_unlock(&trace_lock);
+	return;
+}
+
+const char *feh_trace_event_name(int type)
+{
+	static const char *names[LASTEvent] = {
+		[KeyPress] = "KeyPress",
+		[KeyRelease] = "KeyRelease",
+		[ButtonPress] = "ButtonPress",
+		[ButtonRelease] = "ButtonRelease",
+		[MotionNotify] = "MotionNotify",
+		[EnterNotify] = "EnterNotify",
+		[LeaveNotify] = "LeaveNotify",
+		[FocusIn] = "FocusIn",
+		[FocusOut] = "FocusOut",
+		[Expose] = "Expose",
+		[VisibilityNotify] = "VisibilityNotify",
+		[MapNotify] = "MapNotify",
+		[UnmapNotify] = "UnmapNotify",
+		[ReparentNotify] = "ReparentNotify",
+		[ConfigureNotify] = "ConfigureNotify",
+		[PropertyNotify] = "PropertyNotify",
+		[ClientMessage] = "ClientMessage",
+	};
+
+	if ((type < 0) || (type >= LASTEvent) || !names[type])
+		return("XEvent");
+	return(names[type]);
+}
@@ -0,0 +1,752 @@
+/* watch.c
+
+Copyright (C) 2026 feh contributors.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to
+deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies of the Software and its documentation and acknowledgment shall be
+given in the documentation and software packages that this Software was
+used.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "feh.h"
+#include "filelist.h"
+#include "options.h"
+#include "winwidget.h"
+#include "prefetch.h"
+#include "dirscan.h"
+#include "timers.h"
+#include "watch.h"
+
+/*
+ * Incremental --reload.
+ *
+ * A full reload rescans every directory and sorts the whole filelist again,
+ * which for the sort modes needing file infos means loading every image.
+ * On Linux, the directories found by the initial scan are watched with
+ * inotify instead, and each reload only applies what has changed since the
+ * last one: new files are inserted at their place in the current sort
+ * order, removed ones are taken out and modified ones are invalidated.
+ *
+ * This is only possible if every input is a directory. Files given on the
+ * command line, URLs, --filelist, a directory which cannot be watched, a
+ * watch queue overflow, or the removal of an input directory itself all
+ * fall back to a full reload.
+ */
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+		| IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+typedef struct __watch_file watch_file;
+
+/* filelist entries by file name */
+struct __watch_file {
+	gib_list *node;
+	int pending;	/* node is in pending, not in filelist */
+	watch_file *next;
+};
+
+static int watch_fd = -1;
+static int watching = 0;
+
+/* set if a directory could not be watched, so changes in it would be lost */
+static int watch_failed = 0;
+static int watch_warned = 0;
+
+/* watched directory paths, indexed by watch descriptor */
+static char **dirs = NULL;
+static int dir_size = 0;
+
+/*
+ * Watch descriptors of directories which were read before they were
+ * watched. Files created in between are only found by reading them again.
+ */
+static int *unchecked = NULL;
+static int unchecked_count = 0;
+static int unchecked_size = 0;
+
+/* the input directories, in command line order */
+static char **roots = NULL;
+static int root_count = 0;
+
+/* new and resorted files, merged into filelist at the end of each apply */
+static gib_list *pending = NULL;
+
+static watch_file **files = NULL;
+static unsigned int file_buckets = 0;
+static unsigned int file_count = 0;
+
+static unsigned int feh_watch_hash(char *s)
+{
+	unsigned int hash = 2166136261U;
+
+	for (; *s; s++)
+		hash = (hash ^ (unsigned char) *s) * 16777619U;
+	return(hash);
+}
+
+static watch_file **feh_watch_find(char *filename)
+{
+	watch_file **f;
+
+	if (!file_buckets)
+		return(NULL);
+
+	for (f = &files[feh_watch_hash(filename) & (file_buckets - 1)]; *f; f = &(*f)->next)
+		if (!strcmp(FEH_FILE((*f)->node->data)->filename, filename))
+			return(f);
+	return(NULL);
+}
+
+static watch_file *feh_watch_hash_add(gib_list *node)
+{
+	watch_file **old_files = files, *f, *next;
+	unsigned int old_buckets = file_buckets, i, b;
+
+	if (file_count >= file_buckets) {
+		file_buckets = file_buckets ? file_buckets * 2 : 1024;
+		files = emalloc(file_buckets * sizeof(watch_file *));
+		memset(files, 0, file_buckets * sizeof(watch_file *));
+		for (i = 0; i < old_buckets; i++) {
+			for (f = old_files[i]; f; f = next) {
+				next = f->next;
+				b = feh_watch_hash(FEH_FILE(f->node->data)->filename) & (file_buckets - 1);
+				f->next = files[b];
+				files[b] = f;
+			}
+		}
+		free(old_files);
+	}
+
+	f = emalloc(sizeof(watch_file));
+	f->node = node;
+	f->pending = 0;
+	b = feh_watch_hash(FEH_FILE(node->data)->filename) & (file_buckets - 1);
+	f->next = files[b];
+	files[b] = f;
+	file_count++;
+	return(f);
+}
+
+static void feh_watch_hash_remove(watch_file **f)
+{
+	watch_file *old = *f;
+
+	*f = old->next;
+	free(old);
+	file_count--;
+	return;
+}
+
+/* Called by the directory scanner for every directory it reads */
+void feh_watch_add_dir(char *path)
+{
+	int wd;
+
+	if (watch_fd < 0) {
+		if ((watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+			weprintf("--reload: inotify_init1 failed, reloading everything:");
+			return;
+		}
+	}
+
+	if ((wd = inotify_add_watch(watch_fd, path, WATCH_MASK)) < 0) {
+		if (!watch_warned)
+			weprintf("--reload: cannot watch %s, reloading everything:", path);
+		watch_warned = 1;
+		watch_failed = 1;
+		return;
+	}
+
+	if (wd >= dir_size) {
+		int old_size = dir_size;
+
+		dir_size = (wd + 1) * 2;
+		dirs = erealloc(dirs, dir_size * sizeof(char *));
+		memset(dirs + old_size, 0, (dir_size - old_size) * sizeof(char *));
+	}
+	free(dirs[wd]);
+	dirs[wd] = estrdup(path);
+
+	if (unchecked_count == unchecked_size) {
+		unchecked_size = unchecked_size ? unchecked_size * 2 : 64;
+		unchecked = erealloc(unchecked, unchecked_size * sizeof(int));
+	}
+	unchecked[unchecked_count++] = wd;
+	return;
+}
+
+void feh_watch_reset(void)
+{
+	int i;
+
+	if (watch_fd >= 0)
+		close(watch_fd);
+	watch_fd = -1;
+	watching = 0;
+	watch_failed = 0;
+
+	for (i = 0; i < dir_size; i++)
+		free(dirs[i]);
+	free(dirs);
+	dirs = NULL;
+	dir_size = 0;
+
+	free(unchecked);
+	unchecked = NULL;
+	unchecked_count = 0;
+	unchecked_size = 0;
+
+	for (i = 0; i < root_count; i++)
+		free(roots[i]);
+	free(roots);
+	roots = NULL;
+	root_count = 0;
+
+	for (i = 0; i < (int) file_buckets; i++)
+		while (files[i])
+			feh_watch_hash_remove(&files[i]);
+	free(files);
+	files = NULL;
+	file_buckets = 0;
+	return;
+}
+
+static void feh_watch_add_root(char *path)
+{
+	int len = strlen(path);
+
+	roots = erealloc(roots, (root_count + 1) * sizeof(char *));
+	roots[root_count] = estrdup(path);
+	/* the same normalization as in add_file_to_filelist_recursively */
+	if ((len > 1) && (roots[root_count][len - 1] == '/'))
+		roots[root_count][len - 1] = '\0';
+	root_count++;
+	return;
+}
+
+/*
+ * Called once the filelist is complete. Checks whether incremental reloads
+ * are possible and indexes the filelist by file name.
+ */
+void feh_watch_init(void)
+{
+	struct stat st;
+	gib_list *l;
+
+	if (watch_fd < 0)
+		return;
+
+	if (opt.filelistfile || watch_failed)
+		goto fail;
+
+	if (original_file_items) {
+		for (l = gib_list_last(original_file_items); l; l = l->prev) {
+			if (path_is_url(l->data) || stat(l->data, &st) || !S_ISDIR(st.st_mode))
+				goto fail;
+			feh_watch_add_root(l->data);
+		}
+	} else
+		feh_watch_add_root(".");
+
+	for (l = filelist; l; l = l->next)
+		feh_watch_hash_add(l);
+
+	watching = 1;
+	return;
+
+fail:
+	D(("not all inputs are watched directories, reloading everything\n"));
+	feh_watch_reset();
+	return;
+}
+
+void feh_watch_forget(gib_list * file)
+{
+	watch_file **f;
+
+	if (watching && (f = feh_watch_find(FEH_FILE(file->data)->filename))
+			&& ((*f)->node == file))
+		feh_watch_hash_remove(f);
+	return;
+}
+
+/* Index of the input directory filename was found in */
+static int feh_watch_root_of(char *filename)
+{
+	int i, len;
+
+	for (i = 0; i < root_count; i++) {
+		len = strlen(roots[i]);
+		if (!strncmp(filename, roots[i], len) && (filename[len] == '/'))
+			return(i);
+	}
+	return(root_count);
+}
+
+/*
+ * The order in which the directory scanner finds files: by input
+ * directory, then by path with each component compared separately.
+ */
+static int feh_watch_cmp_scan_order(feh_file *file1, feh_file *file2)
+{
+	char c1[PATH_MAX], c2[PATH_MAX];
+	char *p1 = file1->filename, *p2 = file2->filename;
+	int root1 = feh_watch_root_of(p1), root2 = feh_watch_root_of(p2);
+	int len1, len2, cmp;
+
+	if (root1 != root2)
+		return(root1 - root2);
+
+	while (*p1 && *p2) {
+		len1 = strcspn(p1, "/");
+		len2 = strcspn(p2, "/");
+		if ((len1 >= PATH_MAX) || (len2 >= PATH_MAX))
+			return(strcmp(p1, p2));
+		memcpy(c1, p1, len1);
+		c1[len1] = '\0';
+		memcpy(c2, p2, len2);
+		c2[len2] = '\0';
+		if ((cmp = strcoll(c1, c2)) != 0)
+			return(cmp);
+		p1 += len1 + (p1[len1] == '/');
+		p2 += len2 + (p2[len2] == '/');
+	}
+	return(*p1 - *p2);
+}
+
+/* The sort order established by feh_prepare_filelist */
+static int feh_watch_cmp(void *file1, void *file2)
+{
+	int cmp;
+
+	switch (opt.sort) {
+	case SORT_NAME:
+		cmp = feh_cmp_name(file1, file2);
+		break;
+	case SORT_FILENAME:
+		cmp = feh_cmp_filename(file1, file2);
+		break;
+	case SORT_DIRNAME:
+		cmp = feh_cmp_dirname(file1, file2);
+		break;
+	case SORT_MTIME:
+		cmp = feh_cmp_mtime(file1, file2);
+		break;
+	case SORT_WIDTH:
+		cmp = feh_cmp_width(file1, file2);
+		break;
+	case SORT_HEIGHT:
+		cmp = feh_cmp_height(file1, file2);
+		break;
+	case SORT_PIXELS:
+		cmp = feh_cmp_pixels(file1, file2);
+		break;
+	case SORT_SIZE:
+		cmp = feh_cmp_size(file1, file2);
+		break;
+	case SORT_FORMAT:
+		cmp = feh_cmp_format(file1, file2);
+		break;
+	default:
+		cmp = feh_watch_cmp_scan_order(file1, file2);
+		break;
+	}
+	/* shuffled slideshows keep the scan order, see timers.c */
+	return((opt.reverse && !feh_pic_slots_shuffled()) ? -cmp : cmp);
+}
+
+/*
+ * Load the file infos if the filelist was preloaded, and check whether the
+ * file would have survived that.
+ */
+static int feh_watch_accept(feh_file *file)
+{
+	if (!feh_filelist_needs_preload())
+		return(1);
+
+	feh_file_info_free(file->info);
+	file->info = NULL;
+	if (feh_file_info_load(file, NULL))
+		return(0);
+
+	return(((unsigned int) file->info->width >= opt.min_width)
+			&& ((unsigned int) file->info->width <= opt.max_width)
+			&& ((unsigned int) file->info->height >= opt.min_height)
+			&& ((unsigned int) file->info->height <= opt.max_height));
+}
+
+/* Queue the file's node (not part of filelist) for feh_watch_merge */
+static void feh_watch_pend(watch_file *f)
+{
+	f->pending = 1;
+	f->node->prev = NULL;
+	f->node->next = pending;
+	if (pending)
+		pending->prev = f->node;
+	pending = f->node;
+	return;
+}
+
+static int feh_watch_cmp_pos(void *file1, void *file2)
+{
+	return(FEH_FILE(file1)->list_pos - FEH_FILE(file2)->list_pos);
+}
+
+/*
+ * Link the pending nodes into filelist at their sorted positions. They are
+ * sorted first, so each binary search can start where the last one ended,
+ * and linking them in does not move the entries the filelist index points
+ * to. That way the index is only rebuilt once for all of them.
+ */
+static void feh_watch_merge(void)
+{
+	gib_list *node, *at, *last;
+	int shuffle = (opt.sort == SORT_NONE) && opt.randomize
+		&& !feh_pic_slots_shuffled();
+	int len, lo = 0, hi, mid;
+
+	if (!pending)
+		return;
+
+	len = feh_filelist_length();
+	last = feh_filelist_nth(len - 1);
+
+	if (shuffle) {
+		/* list_pos is rebuilt by the filelist index anyway */
+		for (node = pending; node; node = node->next)
+			FEH_FILE(node->data)->list_pos = random() % (len + 1);
+		pending = gib_list_sort(pending, feh_watch_cmp_pos);
+	} else
+		pending = gib_list_sort(pending, feh_watch_cmp);
+
+	while ((node = pending)) {
+		pending = node->next;
+		(*feh_watch_find(FEH_FILE(node->data)->filename))->pending = 0;
+
+		if (shuffle)
+			lo = FEH_FILE(node->data)->list_pos;
+		else {
+			/* after any files comparing equal */
+			for (hi = len; lo < hi; ) {
+				mid = lo + (hi - lo) / 2;
+				if (feh_watch_cmp(node->data, feh_filelist_nth(mid)->data) < 0)
+					hi = mid;
+				else
+					lo = mid + 1;
+			}
+		}
+
+		if ((at = feh_filelist_nth(lo))) {
+			node->next = at;
+			node->prev = at->prev;
+			if (at->prev)
+				at->prev->next = node;
+			else
+				filelist = node;
+			at->prev = node;
+		} else {
+			node->prev = last;
+			node->next = NULL;
+			if (last)
+				last->next = node;
+			else
+				filelist = node;
+			last = node;
+		}
+	}
+	feh_filelist_changed();
+	return;
+}
+
+static int feh_watch_remove_file(char *path)
+{
+	watch_file **f;
+	gib_list *node;
+	int queued;
+
+	if (!(f = feh_watch_find(path)))
+		return(0);
+
+	D(("removing %s\n", path));
+	node = (*f)->node;
+	queued = (*f)->pending;
+	feh_watch_hash_remove(f);
+	if (node == current_file)
+		current_file = NULL;
+	if (queued)
+		pending = feh_file_remove_from_list(pending, node);
+	else
+		filelist = feh_file_remove_from_list(filelist, node);
+	return(1);
+}
+
+static int feh_watch_update_file(char *path)
+{
+	struct stat st;
+	watch_file **f;
+	gib_list *node;
+	feh_file *file;
+
+	if (stat(path, &st) || !S_ISREG(st.st_mode))
+		return(feh_watch_remove_file(path));
+
+	if ((f = feh_watch_find(path))) {
+		D(("%s has changed\n", path));
+		node = (*f)->node;
+		file = FEH_FILE(node->data);
+		feh_prefetch_forget(node);
+		winwidget_forget_file(node);
+		if (!feh_watch_accept(file))
+			return(feh_watch_remove_file(path));
+		/* the file's place may depend on its contents */
+		if ((opt.sort >= SORT_MTIME) && !(*f)->pending) {
+			filelist = gib_list_unlink(filelist, node);
+			feh_filelist_changed();
+			feh_watch_pend(*f);
+		}
+		return(1);
+	}
+
+	D(("adding %s\n", path));
+	file = feh_file_new(path);
+	if (!feh_watch_accept(file)) {
+		feh_file_free(file);
+		return(0);
+	}
+	node = gib_list_new();
+	node->data = file;
+	feh_watch_pend(feh_watch_hash_add(node));
+	filelist_len++;
+	return(1);
+}
+
+static int tree_changes;
+
+static void feh_watch_scanned_file(char *path)
+{
+	tree_changes += feh_watch_update_file(path);
+	return;
+}
+
+static void feh_watch_scan_error(char *path __attribute__((unused)))
+{
+	D(("cannot stat %s: %s\n", path, strerror(errno)));
+	return;
+}
+
+static int feh_watch_add_tree(char *path)
+{
+	tree_changes = 0;
+	feh_scan_directory(path, 1, feh_watch_scanned_file, feh_watch_add_dir,
+			feh_watch_scan_error);
+	return(tree_changes);
+}
+
+/* Forget a directory which was removed or moved away, and all files in it */
+static int feh_watch_remove_tree(char *path)
+{
+	gib_list *l, *next;
+	int len = strlen(path);
+	int changes = 0;
+	int i;
+
+	for (i = 0; i < dir_size; i++)
+		if (dirs[i] && !strncmp(dirs[i], path, len)
+				&& ((dirs[i][len] == '/') || !dirs[i][len]))
+			inotify_rm_watch(watch_fd, i);
+
+	/* rare enough that walking the whole list is fine */
+	feh_watch_merge();
+	for (l = filelist; l; l = next) {
+		next = l->next;
+		if (!strncmp(FEH_FILE(l->data)->filename, path, len)
+				&& (FEH_FILE(l->data)->filename[len] == '/'))
+			changes += feh_watch_remove_file(FEH_FILE(l->data)->filename);
+	}
+	return(changes);
+}
+
+/* Whether path is a directory which is watched already */
+static int feh_watch_has_dir(char *path)
+{
+	int wd;
+
+	/* adding a watch again returns the descriptor it already has */
+	if ((wd = inotify_add_watch(watch_fd, path, WATCH_MASK)) < 0)
+		return(0);
+	return((wd < dir_size) && dirs[wd] && !strcmp(dirs[wd], path));
+}
+
+/*
+ * Read a directory once more after it was first watched and add whatever
+ * appeared between the scan and inotify_add_watch. Changes after that are
+ * reported by inotify.
+ */
+static int feh_watch_check_dir(char *dirpath)
+{
+	struct dirent *de;
+	struct stat st;
+	DIR *dir;
+	char *path;
+	int is_dir;
+	int changes = 0;
+
+	if (!(dir = opendir(dirpath))) {
+		D(("cannot open %s: %s\n", dirpath, strerror(errno)));
+		return(0);
+	}
+
+	while ((de = readdir(dir))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+
+		path = estrjoin("/", dirpath, de->d_name, NULL);
+#ifdef DT_UNKNOWN
+		if ((de->d_type != DT_UNKNOWN) && (de->d_type != DT_LNK))
+			is_dir = (de->d_type == DT_DIR);
+		else
+#endif
+			is_dir = !stat(path, &st) && S_ISDIR(st.st_mode);
+
+		if (is_dir) {
+			if (opt.recursive && !feh_watch_has_dir(path))
+				changes += feh_watch_add_tree(path);
+		} else if (!feh_watch_find(path))
+			changes += feh_watch_update_file(path);
+		free(path);
+	}
+	closedir(dir);
+	return(changes);
+}
+
+/*
+ * Apply all changes reported since the last call to the filelist. Returns
+ * the number of changes applied (0 if nothing happened), or -1 if
+ * incremental reloading is not possible and the filelist needs to be
+ * rebuilt.
+ */
+int feh_watch_apply(void)
+{
+	char buf[16384] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	char *path, *p;
+	ssize_t len;
+	int changes = 0;
+	int i;
+
+	if (!watching || watch_failed)
+		return(-1);
+
+	while ((len = read(watch_fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+			ev = (struct inotify_event *) p;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				D(("inotify queue overflow\n"));
+				changes = -1;
+				goto done;
+			}
+			if ((ev->wd < 0) || (ev->wd >= dir_size) || !dirs[ev->wd])
+				continue;
+			if (ev->mask & IN_IGNORED) {
+				free(dirs[ev->wd]);
+				dirs[ev->wd] = NULL;
+				continue;
+			}
+			if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+				/* subdirectories are taken care of by their parent's event */
+				for (i = 0; i < root_count; i++)
+					if (!strcmp(dirs[ev->wd], roots[i])) {
+						changes = -1;
+						goto done;
+					}
+				continue;
+			}
+			if (!ev->len)
+				continue;
+
+			if ((ev->mask & IN_ISDIR) && !opt.recursive)
+				continue;
+
+			path = estrjoin("/", dirs[ev->wd], ev->name, NULL);
+			if (ev->mask & IN_ISDIR) {
+				if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+					changes += feh_watch_remove_tree(path);
+				else if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+					changes += feh_watch_add_tree(path);
+			} else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+				changes += feh_watch_remove_file(path);
+			else
+				changes += feh_watch_update_file(path);
+			free(path);
+		}
+	}
+
+	/* checking a directory may add (and queue) new subdirectories */
+	while (unchecked_count > 0) {
+		i = unchecked[--unchecked_count];
+		if ((i < dir_size) && dirs[i]) {
+			path = estrdup(dirs[i]);
+			changes += feh_watch_check_dir(path);
+			free(path);
+		}
+	}
+
+	/* a new directory may have failed to be watched */
+	if (watch_failed)
+		changes = -1;
+
+done:
+	/* even if the filelist is rebuilt, the new nodes must be part of it */
+	feh_watch_merge();
+	return(changes);
+}
+
+#else
+
+void feh_watch_add_dir(char *path __attribute__((unused)))
+{
+	return;
+}
+
+void feh_watch_init(void)
+{
+	return;
+}
+
+int feh_watch_apply(void)
+{
+	return(-1);
+}
+
+void feh_watch_forget(gib_list * file __attribute__((unused)))
+{
+	return;
+}
+
+void feh_watch_reset(void)
+{
+	return;
+}
+
+#endif
@@ -29,6 +29,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "timers.h"
 #include "winwidget.h"
 #include "options.h"
+#include "imagecache.h"
+#include "prefetch.h"
+#include "metrics.h"
+#include "trace.h"
 #include "events.h"
 
 static void winwidget_unregister(winwidget win);
@@ -54,6 +58,7 @@ static winwidget winwidget_allocate(void)
 	ret->im_h = 0;
 	ret->im_angle = 0;
 	ret->bg_pmap = 0;
+	ret->back_pmap = 0;
 	ret->bg_pmap_cache = 0;
 	ret->im = NULL;
 	ret->name = NULL;
@@ -79,6 +84,8 @@ static winwidget winwidget_allocate(void)
 	ret->click_offset_y = 0;
 	ret->has_rotated = 0;
 
+	ret->preroll = NULL;
+
 	return(ret);
 }
 
@@ -408,6 +415,11 @@ void winwidget_setup_pixmaps(winwidget winwid)
 			D(("recreating background pixmap (%dx%d)\n", winwid->w, winwid->h));
 			if (winwid->bg_pmap)
 				XFreePixmap(disp, winwid->bg_pmap);
+			/* the other buffer has the old size as well */
+			if (winwid->back_pmap) {
+				XFreePixmap(disp, winwid->back_pmap);
+				winwid->back_pmap = None;
+			}
 
 			if (winwid->w == 0)
 				winwid->w = 1;
@@ -420,63 +432,12 @@ void winwidget_setup_pixmaps(winwidget winwid)
 	return;
 }
 
-void winwidget_render_image(winwidget winwid, int resize, int force_alias)
+/* Draw the visible part of winwid->im (and checks below it) into winwid->bg_pmap */
+static void winwidget_draw_image(winwidget winwid, int antialias)
 {
-	
 	int sx, sy, sw, sh, dx, dy, dw, dh;
 	int calc_w, calc_h;
-	int antialias = 0;
-	//printf("Inside\n");
-	if (!winwid->full_screen && resize) {
-		winwidget_resize(winwid, winwid->im_w, winwid->im_h, 0);
-		winwidget_reset_image(winwid);
-	}
-
-	D(("winwidget_render_image resize %d force_alias %d im %dx%d\n",
-	      resize, force_alias, winwid->im_w, winwid->im_h));
-
-	/* winwidget_setup_pixmaps(winwid) resets the winwid->had_resize flag */
-	int had_resize = winwid->had_resize || resize;
-
-	winwidget_setup_pixmaps(winwid);
-
-	if (had_resize && !opt.keep_zoom_vp && (winwid->type != WIN_TYPE_THUMBNAIL)) {
-		double required_zoom = 1.0;
-		feh_calc_needed_zoom(&required_zoom, winwid->im_w, winwid->im_h, winwid->w, winwid->h);
-
-		winwid->zoom = opt.default_zoom ? (0.01 * opt.default_zoom) : 1.0;
-
-		if ((opt.scale_down || (winwid->full_screen && !opt.default_zoom))
-				&& winwid->zoom > required_zoom)
-			winwid->zoom = required_zoom;
-		else if ((opt.zoom_mode && required_zoom > 1)
-				&& (!opt.default_zoom || required_zoom < winwid->zoom))
-			winwid->zoom = required_zoom;
-
-		if (opt.offset_flags & XValue) {
-			if (opt.offset_flags & XNegative) {
-				winwid->im_x = winwid->w - (winwid->im_w * winwid->zoom) - opt.offset_x;
-			} else {
-				winwid->im_x = - opt.offset_x * winwid->zoom;
-			}
-		} else {
-			winwid->im_x = (int) (winwid->w - (winwid->im_w * winwid->zoom)) >> 1;
-		}
-		if (opt.offset_flags & YValue) {
-			if (opt.offset_flags & YNegative) {
-				winwid->im_y = winwid->h - (winwid->im_h * winwid->zoom) - opt.offset_y;
-			} else {
-				winwid->im_y = - opt.offset_y * winwid->zoom;
-			}
-		} else {
-			winwid->im_y = (int) (winwid->h - (winwid->im_h * winwid->zoom)) >> 1;
-		}
-	}
-
-	winwid->had_resize = 0;
-
-	if (opt.keep_zoom_vp)
-		winwidget_sanitise_offsets(winwid);
+	long long start;
 
 	if (!winwid->full_screen && ((gib_imlib_image_has_alpha(winwid->im))
 				     || (opt.geom_flags & (WidthValue | HeightValue))
@@ -523,11 +484,8 @@ void winwidget_render_image(winwidget winwid, int resize, int force_alias)
 	D(("sx: %d sy: %d sw: %d sh: %d dx: %d dy: %d dw: %d dh: %d zoom: %f\n",
 	   sx, sy, sw, sh, dx, dy, dw, dh, winwid->zoom));
 
-	if ((winwid->zoom != 1.0 || winwid->has_rotated) && !force_alias && !winwid->force_aliasing)
-		antialias = 1;
-
 	D(("winwidget_render(): winwid->im_angle = %f\n", winwid->im_angle));
-	double timeNow = feh_get_time();
+	start = feh_metric_now();
 	if (winwid->has_rotated)
 		gib_imlib_render_image_part_on_drawable_at_size_with_rotation
 			(winwid->bg_pmap, winwid->im, sx, sy, sw, sh, dx, dy, dw, dh,
@@ -540,10 +498,77 @@ void winwidget_render_image(winwidget winwid, int resize, int force_alias)
 								dw, dh, 1,
 								gib_imlib_image_has_alpha(winwid->im),
 								antialias);
-	double timeAfter = feh_get_time();
-	timeAfter -= timeNow;
-	printf("render image time: %f\n", timeAfter);
-	timeNow = feh_get_time();
+	feh_metric_record(METRIC_SCALE, start);
+	return;
+}
+
+/*
+ * Draw winwid->im and its overlays into winwid->bg_pmap. The window itself
+ * is left alone, so this also works for a pre-rolled slide which is not
+ * visible yet. Returns 1 if the image was drawn antialiased.
+ */
+static int winwidget_compose_image(winwidget winwid, int resize, int force_alias)
+{
+	int antialias = 0;
+	long long start;
+
+	D(("winwidget_compose_image resize %d force_alias %d im %dx%d\n",
+	      resize, force_alias, winwid->im_w, winwid->im_h));
+
+	/* winwidget_setup_pixmaps(winwid) resets the winwid->had_resize flag */
+	int had_resize = winwid->had_resize || resize;
+
+	winwidget_setup_pixmaps(winwid);
+
+	if (had_resize && !opt.keep_zoom_vp && (winwid->type != WIN_TYPE_THUMBNAIL)) {
+		double required_zoom = 1.0;
+		feh_calc_needed_zoom(&required_zoom, winwid->im_w, winwid->im_h, winwid->w, winwid->h);
+
+		winwid->zoom = opt.default_zoom ? (0.01 * opt.default_zoom) : 1.0;
+
+		if ((opt.scale_down || (winwid->full_screen && !opt.default_zoom))
+				&& winwid->zoom > required_zoom)
+			winwid->zoom = required_zoom;
+		else if ((opt.zoom_mode && required_zoom > 1)
+				&& (!opt.default_zoom || required_zoom < winwid->zoom))
+			winwid->zoom = required_zoom;
+
+		if (opt.offset_flags & XValue) {
+			if (opt.offset_flags & XNegative) {
+				winwid->im_x = winwid->w - (winwid->im_w * winwid->zoom) - opt.offset_x;
+			} else {
+				winwid->im_x = - opt.offset_x * winwid->zoom;
+			}
+		} else {
+			winwid->im_x = (int) (winwid->w - (winwid->im_w * winwid->zoom)) >> 1;
+		}
+		if (opt.offset_flags & YValue) {
+			if (opt.offset_flags & YNegative) {
+				winwid->im_y = winwid->h - (winwid->im_h * winwid->zoom) - opt.offset_y;
+			} else {
+				winwid->im_y = - opt.offset_y * winwid->zoom;
+			}
+		} else {
+			winwid->im_y = (int) (winwid->h - (winwid->im_h * winwid->zoom)) >> 1;
+		}
+	}
+
+	winwid->had_resize = 0;
+
+	if (opt.keep_zoom_vp)
+		winwidget_sanitise_offsets(winwid);
+
+	if ((winwid->zoom != 1.0 || winwid->has_rotated) && !force_alias && !winwid->force_aliasing)
+		antialias = 1;
+
+	/* A slide shown again at the same size only needs to be copied */
+	if (!had_resize || force_alias || !feh_frame_cache_blit(winwid, antialias)) {
+		winwidget_draw_image(winwid, antialias);
+		if (had_resize && !force_alias)
+			feh_frame_cache_store(winwid, antialias);
+	}
+
+	start = feh_metric_now();
 	if (opt.mode == MODE_NORMAL) {
 		if (opt.caption_path)
 			winwidget_update_caption(winwid);
@@ -559,21 +584,231 @@ void winwidget_render_image(winwidget winwid, int resize, int force_alias)
 			feh_draw_info(winwid);
 		if (winwid->errstr)
 			feh_draw_errstr(winwid);
-		if (winwid->file != NULL) {
-			if (opt.title && winwid->type != WIN_TYPE_THUMBNAIL_VIEWER) {
-				winwidget_rename(winwid, feh_printf(opt.title, FEH_FILE(winwid->file->data), winwid));
-			} else if (opt.thumb_title && winwid->type == WIN_TYPE_THUMBNAIL_VIEWER) {
-				winwidget_rename(winwid, feh_printf(opt.thumb_title, FEH_FILE(winwid->file->data), winwid));
-			}
-		}
 	} else if ((opt.mode == MODE_ZOOM) && !antialias)
 		feh_draw_zoom(winwid);
+	feh_metric_record(METRIC_OVERLAY, start);
+
+	return(antialias);
+}
+
+/* Make the buffer which is not on screen the one to draw into */
+static void winwidget_flip_buffers(winwidget winwid)
+{
+	Pixmap pmap = winwid->bg_pmap;
+
+	winwid->bg_pmap = winwid->back_pmap;
+	winwid->back_pmap = pmap;
+	return;
+}
+
+/* Show winwid->bg_pmap and update the title to match winwid->file */
+static void winwidget_present(winwidget winwid)
+{
+	long long start = feh_metric_now();
+
+	if ((opt.mode == MODE_NORMAL) && (winwid->file != NULL)) {
+		if (opt.title && winwid->type != WIN_TYPE_THUMBNAIL_VIEWER) {
+			winwidget_rename(winwid, feh_printf(opt.title, FEH_FILE(winwid->file->data), winwid));
+		} else if (opt.thumb_title && winwid->type == WIN_TYPE_THUMBNAIL_VIEWER) {
+			winwidget_rename(winwid, feh_printf(opt.thumb_title, FEH_FILE(winwid->file->data), winwid));
+		}
+	}
 
 	XSetWindowBackgroundPixmap(disp, winwid->win, winwid->bg_pmap);
 	XClearWindow(disp, winwid->win);
+	feh_metric_record(METRIC_SWAP, start);
+	return;
+}
+
+void winwidget_render_image(winwidget winwid, int resize, int force_alias)
+{
+	long long start = feh_metric_now();
+	long long trace_begin = feh_trace_begin();
+
+	winwid->render_serial++;
+
+	if (!winwid->full_screen && resize) {
+		winwidget_resize(winwid, winwid->im_w, winwid->im_h, 0);
+		winwidget_reset_image(winwid);
+	}
+
+	winwidget_flip_buffers(winwid);
+	winwidget_compose_image(winwid, resize, force_alias);
+	winwidget_present(winwid);
+	feh_metric_record(METRIC_RENDER, start);
+	feh_trace_end("render", NULL, trace_begin);
 	return;
 }
 
+/*
+ * A slideshow window whose size does not follow the image. Only for those
+ * can the next slide be rendered before it is due.
+ */
+static int winwidget_has_fixed_size(winwidget winwid)
+{
+	return(winwid->full_screen || (opt.geom_flags & (WidthValue | HeightValue)));
+}
+
+/* Give the back buffer borrowed by a pre-rolled slide back to winwid */
+static void winwidget_return_back_buffer(winwidget winwid, winwidget pre)
+{
+	if (!pre->bg_pmap)
+		return;
+
+	if (!winwid->back_pmap && (pre->w == winwid->w) && (pre->h == winwid->h)
+			&& (pre->full_screen == winwid->full_screen))
+		winwid->back_pmap = pre->bg_pmap;
+	else
+		XFreePixmap(disp, pre->bg_pmap);
+	pre->bg_pmap = None;
+	return;
+}
+
+/* Discard the pre-rolled slide, handing its image back to the prefetch ring if keep is set */
+static void winwidget_drop_preroll(winwidget winwid, int keep)
+{
+	winwidget pre = winwid->preroll;
+
+	if (!pre)
+		return;
+
+	/* pre->gc and pre->win belong to winwid */
+	winwidget_return_back_buffer(winwid, pre);
+	if (pre->im && keep)
+		feh_prefetch_give(pre->file, pre->im);
+	else if (pre->im)
+		feh_image_cache_put(pre->im);
+	free(pre);
+	winwid->preroll = NULL;
+	return;
+}
+
+void winwidget_free_preroll(winwidget winwid)
+{
+	winwidget_drop_preroll(winwid, 1);
+	return;
+}
+
+void winwidget_forget_file(gib_list *file)
+{
+	int i;
+
+	for (i = 0; i < window_num; i++)
+		if (windows[i]->preroll && (windows[i]->preroll->file == file))
+			winwidget_drop_preroll(windows[i], 0);
+	return;
+}
+
+void winwidget_preroll(winwidget winwid, gib_list *file)
+{
+	winwidget pre;
+	int loaded = 0;
+
+	if (winwid->preroll && (winwid->preroll->file == file))
+		return;
+
+	winwidget_free_preroll(winwid);
+
+	if (!file || (file == winwid->file))
+		return;
+
+	D(("pre-rolling %s\n", FEH_FILE(file->data)->filename));
+
+	pre = emalloc(sizeof(_winwidget));
+	memcpy(pre, winwid, sizeof(_winwidget));
+	pre->im = NULL;
+	pre->bg_pmap = None;
+	pre->back_pmap = None;
+	pre->bg_pmap_cache = None;
+	pre->name = NULL;
+	pre->errstr = NULL;
+	pre->preroll = NULL;
+	pre->caption_entry = 0;
+	pre->mode = MODE_NORMAL;
+	pre->file = file;
+
+	/* the next slide is usually in the prefetch ring already */
+	if ((!(pre->im = feh_prefetch_hold(file))
+				&& !(loaded = feh_load_image(&pre->im, FEH_FILE(file->data))))
+			|| feh_should_ignore_image(pre->im)) {
+		/* leave it to slideshow_change_image_by_index to complain */
+		if (pre->im)
+			gib_imlib_free_image(pre->im);
+		free(pre);
+		return;
+	}
+
+	pre->im_w = gib_imlib_image_get_width(pre->im);
+	pre->im_h = gib_imlib_image_get_height(pre->im);
+	winwidget_reset_image(pre);
+
+	/*
+	 * Imlib2 only reads the header in feh_load_image, the pixels are
+	 * decoded on first use. If the window keeps its size we can go all the
+	 * way and compose the slide in the window's back buffer; otherwise the
+	 * window has to be resized at the boundary anyways and we just decode.
+	 */
+	if (winwidget_has_fixed_size(winwid)) {
+		pre->bg_pmap = winwid->back_pmap;
+		winwid->back_pmap = None;
+		pre->had_resize = 1;
+		winwidget_compose_image(pre, 1, 0);
+	} else if (loaded) {
+		long long start = feh_metric_now();
+
+		gib_imlib_image_decode(pre->im);
+		feh_metric_record(METRIC_PIXELS, start);
+	}
+
+	winwid->preroll = pre;
+	return;
+}
+
+int winwidget_show_preroll(winwidget winwid, gib_list *file)
+{
+	winwidget pre = winwid->preroll;
+
+	if (!pre || (pre->file != file))
+		return(0);
+
+	winwid->preroll = NULL;
+	winwidget_free_image(winwid);
+
+	winwid->im = pre->im;
+	pre->im = NULL;
+	winwid->file = file;
+	winwid->mode = MODE_NORMAL;
+	winwidget_reset_image(winwid);
+	winwid->im_w = pre->im_w;
+	winwid->im_h = pre->im_h;
+
+	if (pre->bg_pmap && (pre->w == winwid->w) && (pre->h == winwid->h)
+			&& (pre->full_screen == winwid->full_screen)
+			&& (pre->render_serial == winwid->render_serial)
+			&& (opt.mode == MODE_NORMAL)) {
+		winwid->zoom = pre->zoom;
+		winwid->old_zoom = pre->old_zoom;
+		winwid->im_x = pre->im_x;
+		winwid->im_y = pre->im_y;
+		winwid->had_resize = 0;
+
+		/* the frame on screen becomes the next back buffer */
+		if (winwid->back_pmap)
+			XFreePixmap(disp, winwid->back_pmap);
+		winwid->back_pmap = winwid->bg_pmap;
+		winwid->bg_pmap = pre->bg_pmap;
+		pre->bg_pmap = None;
+
+		winwidget_present(winwid);
+	} else {
+		winwidget_return_back_buffer(winwid, pre);
+		winwidget_render_image(winwid, 1, 0);
+	}
+
+	free(pre);
+	return(1);
+}
+
 void winwidget_render_image_cached(winwidget winwid)
 {
 	static GC gc = None;
@@ -581,6 +816,8 @@ void winwidget_render_image_cached(winwidget winwid)
 	if (gc == None) {
 		gc = XCreateGC(disp, winwid->win, 0, NULL);
 	}
+	winwidget_flip_buffers(winwid);
+	winwidget_setup_pixmaps(winwid);
 	XCopyArea(disp, winwid->bg_pmap_cache, winwid->bg_pmap, gc, 0, 0, winwid->w, winwid->h, 0, 0);
 
 	if (opt.caption_path)
@@ -665,11 +902,16 @@ void winwidget_destroy_xwin(winwidget winwid)
 		XFreePixmap(disp, winwid->bg_pmap);
 		winwid->bg_pmap = None;
 	}
+	if (winwid->back_pmap) {
+		XFreePixmap(disp, winwid->back_pmap);
+		winwid->back_pmap = None;
+	}
 	return;
 }
 
 void winwidget_destroy(winwidget winwid)
 {
+	winwidget_free_preroll(winwid);
 	winwidget_destroy_xwin(winwid);
 	if (winwid->name)
 		free(winwid->name);
@@ -925,7 +1167,7 @@ void winwidget_rename(winwidget winwid, char *newname)
 void winwidget_free_image(winwidget w)
 {
 	if (w->im)
-		gib_imlib_free_image(w->im);
+		feh_image_cache_put(w->im);
 	w->im = NULL;
 	w->im_w = 0;
 	w->im_h = 0;
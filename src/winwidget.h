@@ -87,7 +87,13 @@ struct __winwidget {
 	unsigned char had_resize, full_screen;
 	Imlib_Image im;
 	GC gc;
+	/*
+	 * bg_pmap holds the frame which is being composed or shown, back_pmap
+	 * the one shown before it. Rendering happens in the back buffer, which
+	 * is then swapped in, so the window never shows a half-drawn frame.
+	 */
 	Pixmap bg_pmap;
+	Pixmap back_pmap;
 	Pixmap bg_pmap_cache;
 	char *name;
 	gib_list *file;
@@ -116,6 +122,15 @@ struct __winwidget {
 	time_t click_start_time;
 
 	unsigned char has_rotated;
+
+	/* the next slide, loaded (and possibly rendered) ahead of time */
+	winwidget preroll;
+
+	/*
+	 * bumped on every winwidget_render_image, so a pre-rolled frame
+	 * composed before e.g. an overlay or zoom toggle is not shown as is
+	 */
+	unsigned int render_serial;
 };
 
 int winwidget_loadimage(winwidget winwid, feh_file * filename);
@@ -154,6 +169,10 @@ void winwidget_reset_image(winwidget winwid);
 void winwidget_sanitise_offsets(winwidget winwid);
 void winwidget_size_to_image(winwidget winwid);
 void winwidget_render_image_cached(winwidget winwid);
+void winwidget_preroll(winwidget winwid, gib_list *file);
+int winwidget_show_preroll(winwidget winwid, gib_list *file);
+void winwidget_free_preroll(winwidget winwid);
+void winwidget_forget_file(gib_list *file);
 
 extern int window_num;		/* For window list */
 extern winwidget *windows;	/* List of windows to loop though */
@@ -0,0 +1,139 @@
+#!/usr/bin/env perl
+# End-to-end check of time-synchronized slide changes: run feh under Xvfb,
+# grab the screen over and over from every slot boundary on until it shows
+# the image belonging to that slot, check that it still does in the middle
+# of the slot, and check that each slot's image was on screen soon enough
+# after the slot boundary.
+#
+# usage: prove test/slide-latency-i.t
+#
+# FEH_SLOTS (default 10) sets the number of slots to check and
+# FEH_MAX_LATENCY_MS (default 100) the allowed boundary-to-visible latency.
+# The latency is measured up to the end of the first screen grab showing the
+# new image, so it includes the time one grab takes; raise the limit on
+# machines where import is slow.
+# Needs Xvfb and ImageMagick's import. Run from the source directory after
+# building feh.
+use strict;
+use warnings;
+use 5.010;
+
+use Digest::MD5 qw/md5_hex/;
+use List::Util qw/max/;
+use POSIX qw/ceil floor/;
+use Test::More;
+use Time::HiRes qw/sleep time/;
+
+my $feh         = 'src/feh';
+my $delay       = 1;
+my $settle      = 2;
+my $slots       = $ENV{FEH_SLOTS}          // 10;
+my $max_latency = $ENV{FEH_MAX_LATENCY_MS} // 100;
+my $tmp_dir     = "/tmp/feh-slide-latency-$$";
+my $display     = ':9';
+my @colors      = ( [ 255, 0, 0 ], [ 0, 255, 0 ], [ 0, 0, 255 ], [ 255, 255, 0 ] );
+my $crop        = '8x8+156+116';
+my ( $pid_xvfb, $pid_feh );
+
+plan tests => $slots + 2;
+
+$ENV{HOME} = 'test';
+
+# The images are solid colors, so any part of them has a known checksum
+sub expected_sum {
+	my ($index) = @_;
+
+	return md5_hex( pack( 'C3', @{ $colors[$index] } ) x 64 );
+}
+
+sub screen_sum {
+	my $pixels = qx{import -silent -window root -depth 8 -crop ${crop} rgb:-};
+
+	return md5_hex($pixels);
+}
+
+mkdir($tmp_dir);
+my @images;
+for my $i ( 0 .. $#colors ) {
+	my $file = "${tmp_dir}/${i}.ppm";
+	open( my $fh, '>', $file ) or die("Cannot write ${file}: $!\n");
+	binmode($fh);
+	print $fh "P6\n32 32\n255\n" . ( pack( 'C3', @{ $colors[$i] } ) x 1024 );
+	close($fh);
+	push( @images, $file );
+}
+
+if ( ( $pid_xvfb = fork() ) == 0 ) {
+	open( STDERR, '>', '/dev/null' );
+	exec( 'Xvfb', $display, qw(-screen 0 320x240x24) );
+}
+$ENV{DISPLAY} = $display;
+sleep(2);
+
+if ( ( $pid_feh = fork() ) == 0 ) {
+	open( STDERR, '>', "${tmp_dir}/log" );
+	exec( $feh, '--verbose', '--fullscreen', '--slideshow-delay', $delay,
+		@images );
+}
+
+# slot -> latency between its boundary and its image being on screen, in ms
+my %latency;
+
+# skip startup, then watch the screen from each slot boundary on
+my $slot = ceil( time() / $delay ) + $settle;
+my $first_slot = $slot;
+
+for ( 1 .. $slots ) {
+	my $boundary = $slot * $delay;
+	my $index    = $slot % @images;
+	my $expected = expected_sum($index);
+	my $stable   = 0;
+	my $shown;
+
+	my $wait = $boundary - time();
+	sleep($wait) if $wait > 0;
+
+	while ( time() < $boundary + $delay / 2 ) {
+		if ( screen_sum() eq $expected ) {
+			$shown = time();
+			last;
+		}
+	}
+
+	if ( defined $shown ) {
+		$latency{$slot} = ( $shown - $boundary ) * 1000;
+		$wait = $boundary + $delay / 2 - time();
+		sleep($wait) if $wait > 0;
+		$stable = ( screen_sum() eq $expected );
+	}
+
+	ok( $stable, "slot ${slot} shows image ${index}" );
+	$slot++;
+}
+
+kill( 'TERM', $pid_feh );
+waitpid( $pid_feh, 0 );
+kill( 'TERM', $pid_xvfb );
+waitpid( $pid_xvfb, 0 );
+
+# slots feh reports to have shown
+my %logged;
+
+open( my $fh, '<', "${tmp_dir}/log" ) or die("Cannot read feh log: $!\n");
+while ( my $line = <$fh> ) {
+	if ( $line =~ m{ ^ sync: \s slot \s (\d+) \s shown \s at \s }x ) {
+		$logged{$1} = 1;
+	}
+}
+close($fh);
+
+unlink( @images, "${tmp_dir}/log" );
+rmdir($tmp_dir);
+
+is( scalar( grep { $_ >= $first_slot and $_ < $slot } keys %logged ),
+	$slots, 'feh logged every slot change' );
+
+my @checked = grep { $_ >= $first_slot and $_ < $slot } keys %latency;
+my $worst = ( @checked == $slots ) ? max( map { $latency{$_} } @checked ) : 'inf';
+cmp_ok( $worst, '<', $max_latency,
+	"boundary-to-visible latency (max ${worst} ms) is below ${max_latency} ms" );